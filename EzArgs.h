@@ -4,8 +4,51 @@
 #include <string>
 #include <functional>
 #include <map>
+#include <set>
 #include <sstream>
 #include <iostream>
+#include <optional>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+#include <array>
+#include <unordered_map>
+#include <filesystem>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <bitset>
+#include <charconv>
+#include <limits>
+#include <fstream>
+#include <atomic>
+#include <utility>
+#include <numeric>
+#include <chrono>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <stdlib.h>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+extern "C" {
+extern char** environ;
+}
+#endif
 
 namespace EzArgs {
 
@@ -27,6 +70,15 @@ enum class Error {
     RuleExpectedAtLeastOneOf,
     RuleOptionsMutuallyExclusive,
     RuleExpectedAllOrNoneOf,
+    InvalidCompiledSchema,
+    InvalidEnvironmentExpansion,
+    GlobMatchedNothing,
+    DuplicateMapKey,
+    InvalidValidator,
+    ValidationFailed,
+    NoOpenScope,
+    ConstraintViolated,
+    WrongParameterCount,
 };
 
 enum class Parameter {
@@ -56,7 +108,34 @@ using ParameterParser = const std::function<Error(const std::string& parameter,
  * duplicates, unrecognised args, or invalid parameter values here.
  */
 using ParsedArg = std::tuple<int, std::string, std::optional<std::string>>;
-using ArgsParser = std::function<std::tuple<std::vector<ParsedArg>, std::vector<std::string>>(int argc, char** argv, const ErrorHandler& errorFunc_)>;
+using ParsedArgs = std::tuple<std::vector<ParsedArg>, std::vector<std::string>>;
+using ArgsParser = std::function<ParsedArgs(int argc, char** argv, const ErrorHandler& errorFunc_)>;
+
+/**
+ * An ArgsTokeniser is an ArgsParser which also passes the index of the arg each
+ * error was found in, or -1 if it can't be attributed to a single arg. It is
+ * given the most values each alias takes, further values following an alias
+ * are joined to its parameter separated by '\0', up to that count.
+ */
+using ArgErrorHandler = std::function<void(Error error, const std::string& where, int argIndex)>;
+using ValueCountLookup = std::function<unsigned(const std::string& alias)>;
+using ArgsTokeniser = std::function<ParsedArgs(int argc, char** argv, const ArgErrorHandler& errorFunc_, const ValueCountLookup& maxValues)>;
+
+/**
+ * Args tokenised by ArgParser::Tokenise(...), along with any errors found
+ * while tokenising, which are reported by every parse of these args.
+ */
+struct TokeniseError {
+    Error error_;
+    std::string where_;
+    int argIndex_;
+};
+
+struct TokenisedArgs {
+    std::vector<ParsedArg> parsedArgs_;
+    std::vector<std::string> positionalArgs_;
+    std::vector<TokeniseError> errors_;
+};
 
 /**
  * @brief A rule must return true if the parsed args meet its criteria, and
@@ -64,9 +143,22 @@ using ArgsParser = std::function<std::tuple<std::vector<ParsedArg>, std::vector<
  */
 using Rule = std::function<bool(const std::vector<ParsedArg>& parsedArgs, const ErrorHandler& errorHandler)>;
 
+/**
+ * @brief A Constraint checks the converted values of the Options named by its
+ *        aliases, once every Option's action has run. The check must return
+ *        true if the values are acceptable. Use the Constrain... helpers to
+ *        create them.
+ */
+struct Constraint {
+    std::vector<std::string> aliases_;
+    std::function<bool()> check_;
+};
+
 using OptionActionNoParam = std::function<Error()>;
 using OptionActionOptionalParam = std::function<Error(const std::optional<std::string>&)>;
 using OptionActionRequiredParam = std::function<Error(const std::string&)>;
+using OptionActionMoveParam = std::function<Error(std::string&&)>;
+using OptionActionIndexedParam = std::function<Error(const std::string&, int argIndex)>;
 
 /**
  * A constructor per Parameter::None, Parameter::Optional, & Parameter::Required
@@ -84,7 +176,7 @@ public:
         : paramRequirements_(Parameter::None)
     {
         if (optionAction != nullptr) {
-            action_ = [action = std::move(optionAction)](auto param) -> Error
+            action_ = [action = std::move(optionAction)](const std::optional<std::string>& param) -> Error
             {
                 if (param) {
                     return Error::UnexpectedParameter;
@@ -112,7 +204,7 @@ public:
         : paramRequirements_(Parameter::Required)
     {
         if (optionAction != nullptr) {
-            action_ = [action = std::move(optionAction)](auto param) -> Error
+            action_ = [action = std::move(optionAction)](const std::optional<std::string>& param) -> Error
             {
                 if (param) {
                     return action(param.value());
@@ -123,19 +215,402 @@ public:
         }
     }
 
+    /**
+     * Converts the action to one which takes ownership of the parameter, which
+     * is moved out of the parse rather than copied, and specifies
+     * Parameter::Required. Actions only reading the parameter can instead take
+     * a std::string_view via OptionActionRequiredParam, which never copies.
+     */
+    static OptionAction TakingOwnership(OptionActionMoveParam&& optionAction)
+    {
+        OptionAction onParse(OptionActionRequiredParam(nullptr));
+        if (optionAction != nullptr) {
+            onParse.SetInvoke([action = std::move(optionAction)](std::optional<std::string>& param, int) -> Error
+            {
+                if (param) {
+                    return action(std::move(param.value()));
+                } else {
+                    return Error::ExpectedParameter;
+                }
+            });
+            onParse.takesOwnership_ = true;
+        }
+        return onParse;
+    }
+
+    /**
+     * Converts the action to one which is also passed the index in argv of
+     * the arg that triggered it, e.g. to record where a scope was opened, and
+     * specifies Parameter::Required. The index is -1 if the action is called
+     * through GetAction().
+     */
+    static OptionAction ReceivingArgIndex(OptionActionIndexedParam&& optionAction)
+    {
+        OptionAction onParse(OptionActionRequiredParam(nullptr));
+        if (optionAction != nullptr) {
+            onParse.SetInvoke([action = std::move(optionAction)](std::optional<std::string>& param, int argIndex) -> Error
+            {
+                if (param) {
+                    return action(param.value(), argIndex);
+                } else {
+                    return Error::ExpectedParameter;
+                }
+            });
+        }
+        return onParse;
+    }
+
+    /**
+     * Returns a copy of the action accepting between minValues and maxValues
+     * values, e.g. "--point 1 2 3", see SetValues(...). The action is passed
+     * the values joined by '\0', see SplitValues(...). ArgParser reports
+     * Error::WrongParameterCount for any other number of values.
+     */
+    OptionAction WithArity(unsigned minValues, unsigned maxValues) const
+    {
+        OptionAction onParse(*this);
+        onParse.minValues_ = minValues;
+        onParse.maxValues_ = maxValues;
+        return onParse;
+    }
+
     Parameter GetParameterRequirements() const
     {
         return paramRequirements_;
     }
 
+    unsigned GetMinValues() const
+    {
+        return minValues_;
+    }
+
+    unsigned GetMaxValues() const
+    {
+        return maxValues_;
+    }
+
     const OptionActionOptionalParam& GetAction() const
     {
         return action_;
     }
 
+    /**
+     * Returns true if Invoke(...) moves from the parameter.
+     */
+    bool TakesOwnership() const
+    {
+        return takesOwnership_;
+    }
+
+    /**
+     * Runs the action, moving from the parameter if TakesOwnership().
+     *
+     * @param argIndex The index in argv of the arg that triggered the action.
+     */
+    Error Invoke(std::optional<std::string>& param, int argIndex = -1) const
+    {
+        return invoke_ ? invoke_(param, argIndex) : action_(param);
+    }
+
 private:
+    using InvokeAction = std::function<Error(std::optional<std::string>&, int argIndex)>;
+
     const Parameter paramRequirements_;
     OptionActionOptionalParam action_;
+    // Set instead of action_ for actions taking ownership or the arg index
+    InvokeAction invoke_;
+    bool takesOwnership_ = false;
+    unsigned minValues_ = 1;
+    unsigned maxValues_ = 1;
+
+    void SetInvoke(InvokeAction&& invoke)
+    {
+        invoke_ = std::move(invoke);
+        // GetAction() only sees a const parameter, so is passed a copy
+        action_ = [invoke = invoke_](const std::optional<std::string>& param) -> Error
+        {
+            std::optional<std::string> copy = param;
+            return invoke(copy, -1);
+        };
+    }
+};
+
+/**
+ * @brief The Validator struct declares a check an Option's parameter must pass
+ *        before the Option's action is run. Use the Validate... helpers to
+ *        create them. Validators are compiled by ArgParser::SetOptions(...).
+ */
+struct Validator {
+    enum class Kind {
+        Range,
+        Length,
+        Characters,
+        Pattern,
+    };
+
+    Kind kind_;
+    double min_ = 0.0;
+    double max_ = 0.0;
+    std::string pattern_ = "";
+};
+
+/**
+ * The parameter must be a number between min and max inclusive.
+ */
+inline Validator ValidateRange(double min, double max)
+{
+    return { Validator::Kind::Range, min, max };
+}
+
+/**
+ * The parameter must be between min and max characters long inclusive.
+ */
+inline Validator ValidateLength(std::size_t min, std::size_t max)
+{
+    return { Validator::Kind::Length, static_cast<double>(min), static_cast<double>(max) };
+}
+
+/**
+ * Every character of the parameter must be in the class, which is written as
+ * the inside of a "[...]" bracket expression, e.g. "a-zA-Z0-9_-".
+ */
+inline Validator ValidateCharacters(std::string characterClass)
+{
+    return { Validator::Kind::Characters, 0.0, 0.0, std::move(characterClass) };
+}
+
+/**
+ * The whole parameter must match the pattern, a subset of regular expression
+ * syntax without groups or alternation. Literal characters, '.' for any
+ * character, "[a-z]" and "[^a-z]" classes, "\d", "\w", "\s" and '\' to
+ * escape a special character can each be followed by '*', '+' or '?', e.g.
+ * "[a-z][a-z0-9.-]*" for a lower case hostname.
+ */
+inline Validator ValidatePattern(std::string pattern)
+{
+    return { Validator::Kind::Pattern, 0.0, 0.0, std::move(pattern) };
+}
+
+// Private namespace for hidden internal helpers
+namespace {
+
+template <typename T>
+inline ParameterParser<T> GetDefaultParser();
+
+} // end private namespace
+
+/**
+ * @brief The CompiledValidator class is a Validator prepared for checking
+ *        parameters without allocating. Character classes become a bitset
+ *        and patterns a DFA, with a row of 256 transitions per state. Range
+ *        converts the parameter with GetDefaultParser<double>(), so it agrees
+ *        with SetValue(...) on what is a number, which may allocate.
+ */
+class CompiledValidator {
+public:
+    /**
+     * @return An empty optional if the Validator is malformed.
+     */
+    static std::optional<CompiledValidator> Compile(const Validator& validator)
+    {
+        CompiledValidator compiled;
+        compiled.kind_ = validator.kind_;
+        compiled.min_ = validator.min_;
+        compiled.max_ = validator.max_;
+        switch (validator.kind_) {
+        case Validator::Kind::Range :
+        case Validator::Kind::Length :
+            if (!(validator.min_ <= validator.max_)) {
+                return {};
+            }
+            break;
+        case Validator::Kind::Characters :
+            if (!ParseCharacterClass(validator.pattern_, compiled.characters_)) {
+                return {};
+            }
+            break;
+        case Validator::Kind::Pattern :
+            if (!compiled.CompilePattern(validator.pattern_)) {
+                return {};
+            }
+            break;
+        }
+        return compiled;
+    }
+
+    bool Check(std::string_view parameter) const
+    {
+        switch (kind_) {
+        case Validator::Kind::Range : {
+            double value = 0.0;
+            return GetDefaultParser<double>()(std::string(parameter), value) == Error::None && value >= min_ && value <= max_;
+        }
+        case Validator::Kind::Length :
+            return parameter.size() >= min_ && parameter.size() <= max_;
+        case Validator::Kind::Characters :
+            return std::all_of(parameter.cbegin(), parameter.cend(), [&](char c){ return characters_.test(static_cast<unsigned char>(c)); });
+        case Validator::Kind::Pattern : {
+            std::uint16_t state = startState;
+            for (char c : parameter) {
+                state = transitions_[state][static_cast<unsigned char>(c)];
+                if (state == deadState) {
+                    return false;
+                }
+            }
+            return accepting_[state];
+        }
+        }
+        return false;
+    }
+
+    std::size_t GetStateCount() const
+    {
+        return transitions_.size();
+    }
+
+    std::size_t GetMemoryFootprint() const
+    {
+        return transitions_.capacity() * sizeof(transitions_.front()) + accepting_.capacity();
+    }
+
+private:
+    static constexpr std::uint16_t deadState = 0;
+    static constexpr std::uint16_t startState = 1;
+    // Positions are tracked as bits of a 64 bit mask, one more than the atoms
+    static constexpr std::size_t maxAtoms = 63;
+    // Subset construction can need exponentially many states, e.g. "[ab]*a[ab][ab]..."
+    static constexpr std::size_t maxStates = 1024;
+
+    Validator::Kind kind_ = Validator::Kind::Range;
+    double min_ = 0.0;
+    double max_ = 0.0;
+    std::bitset<256> characters_;
+    std::vector<std::array<std::uint16_t, 256>> transitions_;
+    std::vector<std::uint8_t> accepting_;
+
+    static bool ParseCharacterClass(std::string_view spec, std::bitset<256>& charactersOut)
+    {
+        charactersOut.reset();
+        for (std::size_t i = 0; i < spec.size(); i++) {
+            if (i + 2 < spec.size() && spec[i + 1] == '-') {
+                if (static_cast<unsigned char>(spec[i]) > static_cast<unsigned char>(spec[i + 2])) {
+                    return false;
+                }
+                for (unsigned c = static_cast<unsigned char>(spec[i]); c <= static_cast<unsigned char>(spec[i + 2]); c++) {
+                    charactersOut.set(c);
+                }
+                i += 2;
+            } else {
+                charactersOut.set(static_cast<unsigned char>(spec[i]));
+            }
+        }
+        return !spec.empty();
+    }
+
+    bool CompilePattern(std::string_view pattern)
+    {
+        struct Atom {
+            std::bitset<256> characters_;
+            char quantifier_;
+        };
+        std::vector<Atom> atoms;
+        for (std::size_t i = 0; i < pattern.size(); i++) {
+            Atom atom{ {}, '1' };
+            char c = pattern[i];
+            if (c == '*' || c == '+' || c == '?') {
+                return false;
+            } else if (c == '.') {
+                atom.characters_.set();
+            } else if (c == '[') {
+                std::size_t first = i + 1;
+                bool negate = first < pattern.size() && pattern[first] == '^';
+                if (negate) {
+                    first++;
+                }
+                std::size_t close = pattern.find(']', first + 1);
+                if (close == pattern.npos || !ParseCharacterClass(pattern.substr(first, close - first), atom.characters_)) {
+                    return false;
+                }
+                if (negate) {
+                    atom.characters_.flip();
+                }
+                i = close;
+            } else if (c == '\\') {
+                if (++i == pattern.size()) {
+                    return false;
+                }
+                switch (pattern[i]) {
+                case 'd' :
+                    ParseCharacterClass("0-9", atom.characters_);
+                    break;
+                case 'w' :
+                    ParseCharacterClass("a-zA-Z0-9_", atom.characters_);
+                    break;
+                case 's' :
+                    ParseCharacterClass(" \t\n\r\f\v", atom.characters_);
+                    break;
+                default :
+                    atom.characters_.set(static_cast<unsigned char>(pattern[i]));
+                    break;
+                }
+            } else {
+                atom.characters_.set(static_cast<unsigned char>(c));
+            }
+
+            if (i + 1 < pattern.size() && (pattern[i + 1] == '*' || pattern[i + 1] == '+' || pattern[i + 1] == '?')) {
+                atom.quantifier_ = pattern[++i];
+            }
+            if (atom.quantifier_ == '+') {
+                // "x+" is "xx*"
+                atoms.push_back({ atom.characters_, '1' });
+                atom.quantifier_ = '*';
+            }
+            atoms.push_back(atom);
+        }
+        if (atoms.size() > maxAtoms) {
+            return false;
+        }
+
+        // Subset construction, each DFA state is the set of pattern positions the input could be at
+        const std::uint64_t acceptBit = std::uint64_t(1) << atoms.size();
+        auto closure = [&](std::uint64_t positions)
+        {
+            for (std::size_t i = 0; i < atoms.size(); i++) {
+                if ((positions >> i & 1) && atoms[i].quantifier_ != '1') {
+                    positions |= std::uint64_t(1) << (i + 1);
+                }
+            }
+            return positions;
+        };
+        std::map<std::uint64_t, std::uint16_t> stateIds{ { 0, deadState }, { closure(1), startState } };
+        std::vector<std::uint64_t> statePositions{ 0, closure(1) };
+        transitions_.assign(2, {});
+        for (std::size_t state = startState; state < statePositions.size(); state++) {
+            for (unsigned c = 0; c < 256; c++) {
+                std::uint64_t next = 0;
+                for (std::size_t i = 0; i < atoms.size(); i++) {
+                    if ((statePositions[state] >> i & 1) && atoms[i].characters_.test(c)) {
+                        next |= std::uint64_t(1) << (atoms[i].quantifier_ == '*' ? i : i + 1);
+                    }
+                }
+                next = closure(next);
+                auto [iter, inserted] = stateIds.insert({ next, static_cast<std::uint16_t>(statePositions.size()) });
+                if (inserted) {
+                    if (statePositions.size() == maxStates) {
+                        return false;
+                    }
+                    statePositions.push_back(next);
+                    transitions_.push_back({});
+                }
+                transitions_[state][c] = iter->second;
+            }
+        }
+        accepting_.resize(statePositions.size());
+        for (std::size_t state = 0; state < statePositions.size(); state++) {
+            accepting_[state] = (statePositions[state] & acceptBit) != 0;
+        }
+        return true;
+    }
 };
 
 /**
@@ -153,11 +628,63 @@ private:
  *                 cases, e.g SetValue(dMyNum) or DetectPresence(bArgDetected)
  *
  * @param helpText_ Use this text to describe usage of this Option.
+ *
+ * @param validators_ Optional checks the parameter must pass before onParse_
+ *                    is called, e.g. { ValidateRange(1, 256) }.
  */
 struct Option {
     const std::string aliases_;
     const OptionAction onParse_;
     const std::string helpText_;
+    const std::vector<Validator> validators_ = {};
+};
+
+/**
+ * Called by ArgParser::ParseArgs(...) with an alias that matched no Option,
+ * before Error::UnrecognisedAlias is reported. Should return the Options that
+ * provide the alias, e.g. those of a plugin loaded on demand, or nothing.
+ */
+using AliasResolver = std::function<std::vector<Option>(const std::string& alias)>;
+
+/**
+ * @brief The MemoryFootprint struct is an estimate of the bytes an ArgParser
+ *        is holding on to, broken down by structure. Both the inline size of
+ *        each container's elements and any heap allocated string data are
+ *        counted. State captured inside type erased actions and rules is not
+ *        visible and so is not counted.
+ *
+ * @param options_ The Option table, including alias and help strings and the
+ *                 declared Validators.
+ *
+ * @param validators_ The compiled Validators, including pattern DFAs.
+ *
+ * @param aliasIndex_ The alias to Option lookup, including tree node overhead.
+ *
+ * @param aliasTrie_ The dotted alias trie.
+ *
+ * @param rules_ The Rule table.
+ *
+ * @param constraints_ The Constraint table, including alias strings.
+ *
+ * @param resolver_ The AliasResolver, if one is set.
+ *
+ * @param environment_ The EnvironmentSnapshot, if one is set. It may be shared
+ *                     with other parsers, each of which counts it.
+ */
+struct MemoryFootprint {
+    std::size_t options_ = 0;
+    std::size_t validators_ = 0;
+    std::size_t aliasIndex_ = 0;
+    std::size_t aliasTrie_ = 0;
+    std::size_t rules_ = 0;
+    std::size_t constraints_ = 0;
+    std::size_t resolver_ = 0;
+    std::size_t environment_ = 0;
+
+    std::size_t Total() const
+    {
+        return options_ + validators_ + aliasIndex_ + aliasTrie_ + rules_ + constraints_ + resolver_ + environment_;
+    }
 };
 
 // Private namespace for hidden internal helpers
@@ -226,6 +753,68 @@ static std::vector<std::string> ParseAliases(const std::string& aliases)
     return segments;
 }
 
+// Multiple values for one Option are joined by '\0', which can't appear in argv
+template <typename Func>
+inline void ForEachValue(std::string_view parameter, Func&& func)
+{
+    for (std::size_t first = 0;;) {
+        std::size_t last = parameter.find('\0', first);
+        func(parameter.substr(first, last == parameter.npos ? parameter.npos : last - first));
+        if (last == parameter.npos) {
+            break;
+        }
+        first = last + 1;
+    }
+}
+
+/**
+ * Returns the heap bytes owned by the string, zero if the characters fit in
+ * the small string buffer stored inside the string object itself.
+ */
+inline std::size_t StringHeapBytes(const std::string& str)
+{
+    const char* data = str.data();
+    const char* object = reinterpret_cast<const char*>(&str);
+    if (data >= object && data < object + sizeof(std::string)) {
+        return 0;
+    }
+    return str.capacity() + 1;
+}
+
+inline std::uint32_t ReadUint32(const char* data)
+{
+    std::uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline void WriteUint32(std::vector<char>& blob, std::uint32_t value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    blob.insert(blob.end(), bytes, bytes + sizeof(value));
+}
+
+// A double takes the space of two uint32_t fields in a CompiledSchema
+static_assert(sizeof(double) == 2 * sizeof(std::uint32_t));
+
+inline double ReadDouble(const char* data)
+{
+    double value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline void WriteDouble(std::vector<char>& blob, double value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    blob.insert(blob.end(), bytes, bytes + sizeof(value));
+}
+
+// Colour, parent, left and right, as used by the common red-black tree std::map
+constexpr std::size_t mapNodeOverhead = 4 * sizeof(void*);
+// The next pointer and cached hash of a std::unordered_map node
+constexpr std::size_t unorderedMapNodeOverhead = 2 * sizeof(void*);
+
 inline std::vector<unsigned> GetArgIndexesOf(const std::vector<std::string>& ruleAliases, const std::vector<ParsedArg>& parsedArgs)
 {
     std::vector<unsigned> argIndexes;
@@ -268,6 +857,25 @@ std::string PointToArg(int argc, char** argv, int argToPointTo)
     return stream.str();
 }
 
+inline std::string PointToArgs(int argc, char** argv, const std::vector<int>& argsToPointTo)
+{
+    std::stringstream stream;
+    std::string pointers;
+    for (int i = 0; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (std::find(argsToPointTo.cbegin(), argsToPointTo.cend(), i) != argsToPointTo.cend()) {
+            pointers += "^";
+            pointers += std::string(arg.size(), ' ');
+        } else {
+            pointers += std::string(arg.size() + 1, ' ');
+        }
+        stream << arg << " ";
+    }
+    pointers.erase(pointers.find_last_not_of(' ') + 1);
+    stream << std::endl << pointers;
+    return stream.str();
+}
+
 std::string PointToParsedArgs(const std::vector<ParsedArg>& parsedArgs, const std::vector<unsigned>& pointTo)
 {
     std::stringstream stream;
@@ -320,7 +928,7 @@ inline std::string PrintVector(const std::vector<std::string>& vec)
 ///
 
 /**
- * @brief GetDefaultPosixArgsParser
+ * @brief GetDefaultPosixArgsTokeniser
  *        Arguments are either aliases, parameters, a terminator, or positional.
  *        Aliases are long or short, '-a' being a short alias and '--alias'
  *        being a long alias. A parameter is a value that is paired with an
@@ -330,7 +938,8 @@ inline std::string PrintVector(const std::vector<std::string>& vec)
  *        the following is valid '-abc', in the case of '-abc=value' or
  *        '-abc value' then 'value' is applied to 'c' only. '--' is a terminator
  *        meaning the parsing will stop and all following args are considered
- *        positional, and are returned in a vector.
+ *        positional, and are returned in a vector. Each error is reported with
+ *        the index of the arg it was found in.
  *
  * @param allowLongArguments
  *        GNU added long arguments to the POSIX argument conventions
@@ -348,11 +957,12 @@ inline std::string PrintVector(const std::vector<std::string>& vec)
  *       long and short args are, would need to be captured and NOT added to
  *       parser function signature)
  */
-inline ArgsParser GetDefaultPosixArgsParser(bool allowLongArguments = true, bool allowTerminator = true)
+inline ArgsTokeniser GetDefaultPosixArgsTokeniser(bool allowLongArguments = true, bool allowTerminator = true)
 {
-    return [=](int argc, char** argv, const ErrorHandler& errorFunc_) -> std::tuple<std::vector<ParsedArg>, std::vector<std::string>>
+    return [=](int argc, char** argv, const ArgErrorHandler& errorFunc_, const ValueCountLookup& maxValues) -> std::tuple<std::vector<ParsedArg>, std::vector<std::string>>
     {
         int index = 1;
+        unsigned valueCount = 0;
 
         std::vector<ParsedArg> argsAndParams;
         for (; index < argc; index++) {
@@ -366,7 +976,7 @@ inline ArgsParser GetDefaultPosixArgsParser(bool allowLongArguments = true, bool
                             index++;
                             break;
                         } else {
-                            errorFunc_(Error::ExpectedLongAlias, PointToArg(argc, argv, index));
+                            errorFunc_(Error::ExpectedLongAlias, PointToArg(argc, argv, index), index);
                         }
                     } else {
                         auto aliasFirst = 2u;
@@ -379,14 +989,16 @@ inline ArgsParser GetDefaultPosixArgsParser(bool allowLongArguments = true, bool
                             param = arg.substr(paramFirst, paramLast - paramFirst);
                         }
                         argsAndParams.push_back({ index, alias, param });
+                        valueCount = 1;
                     }
                 } else {
-                    errorFunc_(Error::ExpectedShortAlias, PointToArg(argc, argv, index));
+                    errorFunc_(Error::ExpectedShortAlias, PointToArg(argc, argv, index), index);
                 }
             } else if (arg.substr(0, 1) == "-") {
                 if (arg.size() == 1 || arg.at(1) == '=') {
-                    errorFunc_(Error::ExpectedShortAlias, PointToArg(argc, argv, index));
+                    errorFunc_(Error::ExpectedShortAlias, PointToArg(argc, argv, index), index);
                 } else {
+                    valueCount = 1;
                     for (const char& shortAlias : arg.substr(1, arg.npos)) {
                         if (shortAlias == '=') {
                             auto first = arg.find_first_of('=') + 1;
@@ -396,21 +1008,24 @@ inline ArgsParser GetDefaultPosixArgsParser(bool allowLongArguments = true, bool
                         } else if(std::isalpha(shortAlias)) {
                             argsAndParams.push_back({ index, {shortAlias}, {} });
                         } else {
-                            errorFunc_(Error::ExpectedShortAlias, PointToArg(argc, argv, index));
+                            errorFunc_(Error::ExpectedShortAlias, PointToArg(argc, argv, index), index);
                         }
                     }
                 }
             } else if (!argsAndParams.empty()) {
                 if (!std::get<2>(argsAndParams.back())) {
                     std::get<2>(argsAndParams.back()) = arg;
+                } else if (valueCount < maxValues(std::get<1>(argsAndParams.back()))) {
+                    std::get<2>(argsAndParams.back())->append(1, '\0').append(arg);
+                    valueCount++;
                 } else {
-                    errorFunc_(Error::ExpectedAliasIndicator, PointToArg(argc, argv, index));
+                    errorFunc_(Error::ExpectedAliasIndicator, PointToArg(argc, argv, index), index);
                 }
             } else if (index == 1) {
                 // No Alias indicator found, all args are positional
                 break;
             } else {
-                errorFunc_(Error::ExpectedAliasIndicator, PointToArg(argc, argv, index));
+                errorFunc_(Error::ExpectedAliasIndicator, PointToArg(argc, argv, index), index);
             }
         }
 
@@ -423,6 +1038,19 @@ inline ArgsParser GetDefaultPosixArgsParser(bool allowLongArguments = true, bool
     };
 }
 
+/**
+ * @brief GetDefaultPosixArgsParser
+ *        GetDefaultPosixArgsTokeniser(...) for an ErrorHandler, which is not
+ *        passed the arg indexes. Every alias takes at most one value.
+ */
+inline ArgsParser GetDefaultPosixArgsParser(bool allowLongArguments = true, bool allowTerminator = true)
+{
+    return [tokeniser = GetDefaultPosixArgsTokeniser(allowLongArguments, allowTerminator)](int argc, char** argv, const ErrorHandler& errorFunc_)
+    {
+        return tokeniser(argc, argv, [&](Error error, const std::string& where, int){ errorFunc_(error, where); }, [](const std::string&){ return 1u; });
+    };
+}
+
 /**
  * @brief GetDefaultErrorHandler
  *        Prints to 'std::cout'. First prints the 'where' parameter, then on a
@@ -458,7 +1086,7 @@ inline ErrorHandler GetDefaultErrorHandler(bool exitOnError = true)
             std::cout << "Each Option must have unique aliases, they cannot share long or short aliases." << std::endl;
             break;
         case Error::EmptyAlias :
-            std::cout << "Cannot use the comma character ',' as an alias, nor can an alias be an empty string." << std::endl;
+            std::cout << "Cannot use the comma character ',' as an alias, nor can an alias be an empty string or have an empty segment between dots '.'." << std::endl;
             break;
         case Error::SpaceInAlias :
             std::cout << "Cannot use the space character ' ' in an alias." << std::endl;
@@ -490,6 +1118,33 @@ inline ErrorHandler GetDefaultErrorHandler(bool exitOnError = true)
         case Error::RuleExpectedAllOrNoneOf :
             std::cout << "Program expects either none, or all of these Options be specified at runtime." << std::endl;
             break;
+        case Error::InvalidCompiledSchema :
+            std::cout << "Compiled schema is corrupt, or does not match the actions bound to it." << std::endl;
+            break;
+        case Error::InvalidEnvironmentExpansion :
+            std::cout << "Parameter contains a \"${\" without a closing \"}\", use \"$$\" for a literal \"$\"." << std::endl;
+            break;
+        case Error::GlobMatchedNothing :
+            std::cout << "No files or directories match this pattern." << std::endl;
+            break;
+        case Error::DuplicateMapKey :
+            std::cout << "This key has already been specified." << std::endl;
+            break;
+        case Error::InvalidValidator :
+            std::cout << "Option has a validator with an invalid range, character class or pattern." << std::endl;
+            break;
+        case Error::ValidationFailed :
+            std::cout << "Parameter is outside the range, length, characters or pattern accepted by this option." << std::endl;
+            break;
+        case Error::NoOpenScope :
+            std::cout << "This option applies to a scope, e.g. an input, but no scope has been opened before it." << std::endl;
+            break;
+        case Error::ConstraintViolated :
+            std::cout << "The values of these options are not allowed together." << std::endl;
+            break;
+        case Error::WrongParameterCount :
+            std::cout << "This option was given too few or too many values." << std::endl;
+            break;
         }
         std::cout << "-----------------" << std::endl;
         if (exitOnError) {
@@ -499,63 +1154,1855 @@ inline ErrorHandler GetDefaultErrorHandler(bool exitOnError = true)
 }
 
 /**
- * @brief The ArgParser class is where the meat of this library is. It is
- *        responsible for parsing the args, with the provided Options and
- *        checking that the parsed args meet all of the provided Rules. It also
- *        is responsible for ensuring that the Options provided are valid.
+ * @brief The CompiledSchema class is a read only view over a blob created by
+ *        ArgParser::CompileSchema(). The blob contains the alias index and the
+ *        aliases, help text, parameter requirements and Validators of each
+ *        Option, but no actions. All offsets are relative to the start of the blob, so it can
+ *        be written to a file or shared memory and mapped at any address by
+ *        another process built for the same platform. The view does not own
+ *        the blob, which must outlive it and any ArgParser using it.
+ *
+ * Layout, every integer is a native endian uint32_t and every double a native
+ * endian double taking the space of two:
+ *   header     { magic, version, optionCount, aliasCount, validatorCount,
+ *                stringsOffset, size }
+ *   options    { aliasesOffset, aliasesSize, helpOffset, helpSize, parameter,
+ *                firstValidator, validatorCount }[]
+ *   aliases    { aliasOffset, aliasSize, optionIndex }[] sorted by alias
+ *   validators { kind, min, max, patternOffset, patternSize }[]
+ *   strings
  */
-class ArgParser {
+class CompiledSchema {
 public:
-    ArgParser(ArgsParser&& argsParser)
-        : ArgParser(GetDefaultErrorHandler(), std::move(argsParser))
-    {}
-    ArgParser(ErrorHandler&& errorHandler = GetDefaultErrorHandler(), ArgsParser&& argsParser = GetDefaultPosixArgsParser())
-        : errorFunc_(std::move(errorHandler))
-        , argsParser_(std::move(argsParser))
+    static constexpr std::uint32_t magic = 0x53415A45; // "EZAS"
+    static constexpr std::uint32_t version = 2;
+    static constexpr std::size_t headerFields = 7;
+    static constexpr std::size_t optionFields = 7;
+    static constexpr std::size_t aliasFields = 3;
+    static constexpr std::size_t validatorFields = 7;
+
+    CompiledSchema(const char* data, std::size_t size)
+        : data_(data)
+        , size_(size)
+    {}
+
+    /**
+     * Checks the header and that every offset lies within the blob, so a
+     * truncated or foreign blob is never read past its end.
+     */
+    bool IsValid() const
+    {
+        const std::size_t headerSize = headerFields * sizeof(std::uint32_t);
+        if (data_ == nullptr || size_ < headerSize || Field(0) != magic || Field(1) != version || Field(6) != size_) {
+            return false;
+        }
+        const std::size_t tablesEnd = headerSize + (std::size_t(OptionCount()) * optionFields + std::size_t(AliasCount()) * aliasFields + std::size_t(ValidatorCount()) * validatorFields) * sizeof(std::uint32_t);
+        const std::size_t stringsOffset = Field(5);
+        if (tablesEnd != stringsOffset || stringsOffset > size_) {
+            return false;
+        }
+        auto inStrings = [&](std::uint32_t offset, std::uint32_t length)
+        {
+            return offset >= stringsOffset && static_cast<std::size_t>(offset) + length <= size_;
+        };
+        for (unsigned i = 0; i < OptionCount(); i++) {
+            const char* record = OptionRecord(i);
+            if (!inStrings(ReadUint32(record), ReadUint32(record + 4)) || !inStrings(ReadUint32(record + 8), ReadUint32(record + 12)) || ReadUint32(record + 16) > static_cast<std::uint32_t>(Parameter::Required)) {
+                return false;
+            }
+            if (static_cast<std::size_t>(ReadUint32(record + 20)) + ReadUint32(record + 24) > ValidatorCount()) {
+                return false;
+            }
+        }
+        for (unsigned i = 0; i < AliasCount(); i++) {
+            const char* record = AliasRecord(i);
+            if (!inStrings(ReadUint32(record), ReadUint32(record + 4)) || ReadUint32(record + 8) >= OptionCount()) {
+                return false;
+            }
+        }
+        for (unsigned i = 0; i < ValidatorCount(); i++) {
+            const char* record = ValidatorRecord(i);
+            if (ReadUint32(record) > static_cast<std::uint32_t>(Validator::Kind::Pattern) || !inStrings(ReadUint32(record + 20), ReadUint32(record + 24))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    unsigned OptionCount() const
+    {
+        return Field(2);
+    }
+
+    unsigned AliasCount() const
+    {
+        return Field(3);
+    }
+
+    unsigned ValidatorCount() const
+    {
+        return Field(4);
+    }
+
+    std::string_view GetAliases(unsigned optionIndex) const
+    {
+        const char* record = OptionRecord(optionIndex);
+        return String(ReadUint32(record), ReadUint32(record + 4));
+    }
+
+    std::string_view GetHelpText(unsigned optionIndex) const
+    {
+        const char* record = OptionRecord(optionIndex);
+        return String(ReadUint32(record + 8), ReadUint32(record + 12));
+    }
+
+    Parameter GetParameterRequirements(unsigned optionIndex) const
+    {
+        return static_cast<Parameter>(ReadUint32(OptionRecord(optionIndex) + 16));
+    }
+
+    /**
+     * The Validators as declared, they are compiled again when the schema is
+     * bound by ArgParser::SetOptions(...).
+     */
+    std::vector<Validator> GetValidators(unsigned optionIndex) const
+    {
+        const char* option = OptionRecord(optionIndex);
+        const std::uint32_t first = ReadUint32(option + 20);
+        std::vector<Validator> validators;
+        for (std::uint32_t i = first; i < first + ReadUint32(option + 24); i++) {
+            const char* record = ValidatorRecord(i);
+            validators.push_back({ static_cast<Validator::Kind>(ReadUint32(record)), ReadDouble(record + 4), ReadDouble(record + 12), std::string(String(ReadUint32(record + 20), ReadUint32(record + 24))) });
+        }
+        return validators;
+    }
+
+    /**
+     * Binary search of the sorted alias records, no allocations.
+     */
+    std::optional<unsigned> Find(std::string_view alias) const
+    {
+        unsigned first = 0;
+        unsigned last = AliasCount();
+        while (first < last) {
+            unsigned middle = first + (last - first) / 2;
+            const char* record = AliasRecord(middle);
+            int comparison = String(ReadUint32(record), ReadUint32(record + 4)).compare(alias);
+            if (comparison == 0) {
+                return ReadUint32(record + 8);
+            } else if (comparison < 0) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        return {};
+    }
+
+private:
+    const char* data_;
+    std::size_t size_;
+
+    std::uint32_t Field(unsigned index) const
+    {
+        return ReadUint32(data_ + index * sizeof(std::uint32_t));
+    }
+
+    const char* OptionRecord(unsigned optionIndex) const
+    {
+        return data_ + (headerFields + optionIndex * optionFields) * sizeof(std::uint32_t);
+    }
+
+    const char* AliasRecord(unsigned aliasIndex) const
+    {
+        return data_ + (headerFields + OptionCount() * optionFields + aliasIndex * aliasFields) * sizeof(std::uint32_t);
+    }
+
+    const char* ValidatorRecord(unsigned validatorIndex) const
+    {
+        return data_ + (headerFields + OptionCount() * optionFields + AliasCount() * aliasFields + validatorIndex * validatorFields) * sizeof(std::uint32_t);
+    }
+
+    std::string_view String(std::uint32_t offset, std::uint32_t length) const
+    {
+        return std::string_view(data_ + offset, length);
+    }
+};
+
+/**
+ * @brief The StringPool class stores a single copy of each distinct string
+ *        interned into it. Interned strings remain valid, at the same address,
+ *        for the lifetime of the pool, so equal strings can be compared by
+ *        pointer. They are followed by a NUL, but may also contain NULs, e.g.
+ *        the values of a multi-value parameter, so always use their size.
+ *        The pool is split into shards, each guarded by its own reader/writer
+ *        lock, so it can be shared by any number of threads and parse results.
+ */
+class StringPool {
+public:
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    std::string_view Intern(std::string_view str)
+    {
+        Shard& shard = shards_[std::hash<std::string_view>{}(str) % shardCount];
+        {
+            std::shared_lock lock(shard.mutex_);
+            if (auto iter = shard.strings_.find(str); iter != shard.strings_.end()) {
+                return *iter;
+            }
+        }
+        std::unique_lock lock(shard.mutex_);
+        if (auto iter = shard.strings_.find(str); iter != shard.strings_.end()) {
+            return *iter;
+        }
+        char* copy = shard.Allocate(str.size() + 1);
+        std::copy(str.cbegin(), str.cend(), copy);
+        copy[str.size()] = '\0';
+        return *shard.strings_.insert(std::string_view(copy, str.size())).first;
+    }
+
+    std::size_t Count() const
+    {
+        std::size_t count = 0;
+        for (const Shard& shard : shards_) {
+            std::shared_lock lock(shard.mutex_);
+            count += shard.strings_.size();
+        }
+        return count;
+    }
+
+private:
+    static constexpr std::size_t shardCount = 16;
+    static constexpr std::size_t blockSize = 4096;
+
+    struct Shard {
+        mutable std::shared_mutex mutex_;
+        std::unordered_set<std::string_view> strings_;
+        std::vector<std::unique_ptr<char[]>> blocks_;
+        char* currentBlock_ = nullptr;
+        std::size_t blockUsed_ = blockSize;
+
+        char* Allocate(std::size_t size)
+        {
+            if (size > blockSize / 4) {
+                // Large strings get their own block, so they don't waste the remainder of the current one
+                blocks_.push_back(std::make_unique<char[]>(size));
+                return blocks_.back().get();
+            }
+            if (blockUsed_ + size > blockSize) {
+                blocks_.push_back(std::make_unique<char[]>(blockSize));
+                currentBlock_ = blocks_.back().get();
+                blockUsed_ = 0;
+            }
+            char* memory = currentBlock_ + blockUsed_;
+            blockUsed_ += size;
+            return memory;
+        }
+    };
+
+    std::array<Shard, shardCount> shards_;
+};
+
+/**
+ * @brief A compact form of ParsedArg for storing parse results, the alias is
+ *        replaced by the index of the Option it refers to and the parameter by
+ *        a string interned in a StringPool, with a nullptr data() if there was
+ *        no parameter.
+ */
+struct InternedArg {
+    int index_;
+    unsigned option_;
+    std::string_view parameter_;
+
+    std::optional<std::string_view> GetParameter() const
+    {
+        return parameter_.data() ? std::optional<std::string_view>(parameter_) : std::nullopt;
+    }
+};
+
+struct InternedParseResult {
+    std::vector<InternedArg> args_;
+    std::vector<std::string_view> positionalArgs_;
+};
+
+/**
+ * @brief The EnvironmentSnapshot class is a copy of the environment taken at
+ *        construction, stored in a single buffer and indexed by variable name
+ *        so each lookup is a single hash. Later changes to the environment are
+ *        not seen.
+ */
+class EnvironmentSnapshot {
+public:
+    /**
+     * @param environment A nullptr terminated array of "NAME=value" strings,
+     *                    in the same format as the global environ.
+     */
+    explicit EnvironmentSnapshot(const char* const* environment)
+    {
+        std::size_t size = 0;
+        for (auto entry = environment; entry && *entry; entry++) {
+            size += std::strlen(*entry) + 1;
+        }
+        buffer_.reserve(size);
+        for (auto entry = environment; entry && *entry; entry++) {
+            std::string_view variable = *entry;
+            auto equals = variable.find('=');
+            if (equals == variable.npos || equals == 0) {
+                continue;
+            }
+            buffer_.append(variable).push_back('\0');
+        }
+        Index();
+    }
+
+    static EnvironmentSnapshot FromEnviron()
+    {
+#ifdef _WIN32
+        return EnvironmentSnapshot(_environ);
+#else
+        return EnvironmentSnapshot(environ);
+#endif
+    }
+
+    EnvironmentSnapshot(const EnvironmentSnapshot&) = delete;
+    EnvironmentSnapshot& operator=(const EnvironmentSnapshot&) = delete;
+
+    /**
+     * The index is rebuilt rather than moved, as a short buffer_ is stored
+     * inside the string object, so other's views don't point into ours.
+     */
+    EnvironmentSnapshot(EnvironmentSnapshot&& other)
+        : buffer_(std::move(other.buffer_))
+    {
+        other.buffer_.clear();
+        other.variables_.clear();
+        Index();
+    }
+
+    std::optional<std::string_view> Find(std::string_view name) const
+    {
+        if (auto iter = variables_.find(name); iter != variables_.end()) {
+            return iter->second;
+        }
+        return {};
+    }
+
+    std::size_t GetHeapBytes() const
+    {
+        return buffer_.capacity() + variables_.bucket_count() * sizeof(void*) + variables_.size() * (unorderedMapNodeOverhead + sizeof(std::pair<const std::string_view, std::string_view>));
+    }
+
+private:
+    // "NAME=value" entries, each followed by a '\0'
+    std::string buffer_;
+    // The views point into buffer_, which is never modified after construction
+    std::unordered_map<std::string_view, std::string_view> variables_;
+
+    void Index()
+    {
+        std::string_view entries = buffer_;
+        for (std::size_t first = 0; first < entries.size();) {
+            std::size_t last = entries.find('\0', first);
+            std::string_view variable = entries.substr(first, last - first);
+            auto equals = variable.find('=');
+            variables_.insert({ variable.substr(0, equals), variable.substr(equals + 1) });
+            first = last + 1;
+        }
+    }
+};
+
+/**
+ * @brief ExpandEnvironment replaces each "${NAME}" in the parameter with the
+ *        value of the variable NAME, or with nothing if it is unset. The form
+ *        "${NAME:-default}" is replaced with "default" if NAME is unset or
+ *        empty. "$$" is replaced with a single literal "$", and a "$" followed
+ *        by anything else is left as is.
+ *
+ * @return Error::InvalidEnvironmentExpansion if a "${" is never closed, in
+ *         which case expandedOut is left in an unspecified state.
+ */
+inline Error ExpandEnvironment(std::string_view parameter, const EnvironmentSnapshot& environment, std::string& expandedOut)
+{
+    expandedOut.clear();
+    expandedOut.reserve(parameter.size());
+    std::string_view::size_type index = 0;
+    while (index < parameter.size()) {
+        auto dollar = parameter.find('$', index);
+        expandedOut.append(parameter.substr(index, dollar - index));
+        if (dollar == parameter.npos) {
+            break;
+        }
+        std::string_view rest = parameter.substr(dollar + 1);
+        if (!rest.empty() && rest.front() == '$') {
+            expandedOut.push_back('$');
+            index = dollar + 2;
+        } else if (!rest.empty() && rest.front() == '{') {
+            auto close = rest.find('}');
+            if (close == rest.npos) {
+                return Error::InvalidEnvironmentExpansion;
+            }
+            std::string_view expression = rest.substr(1, close - 1);
+            auto defaultSeperator = expression.find(":-");
+            std::optional<std::string_view> value = environment.Find(expression.substr(0, defaultSeperator));
+            if (defaultSeperator != expression.npos && (!value || value->empty())) {
+                value = expression.substr(defaultSeperator + 2);
+            }
+            expandedOut.append(value.value_or(std::string_view()));
+            index = dollar + 1 + close + 1;
+        } else {
+            expandedOut.push_back('$');
+            index = dollar + 1;
+        }
+    }
+    return Error::None;
+}
+
+/**
+ * @brief The MappedFile class is a read only view of a whole file, memory
+ *        mapped where the platform supports it, and read into memory where it
+ *        doesn't.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = file ? buffer_.size() : 0;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat status;
+        if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+            void* mapping = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data_ = static_cast<const char*>(mapping);
+                size_ = static_cast<std::size_t>(status.st_size);
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+    }
+
+    const char* GetData() const
+    {
+        return data_;
+    }
+
+    std::size_t GetSize() const
+    {
+        return size_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    std::vector<char> buffer_;
+#endif
+};
+
+/**
+ * @brief The AuditRecord struct is one decoded AuditLog record.
+ *
+ * @param timestamp_ Microseconds since the unix epoch when it was written.
+ *
+ * @param error_ The first error reported by the parse, Error::None if the
+ *               parse succeeded.
+ *
+ * @param errorArgIndex_ The index in argv of the arg the error was reported
+ *                       for, -1 on success or if no single arg was at fault.
+ */
+struct AuditRecord {
+    std::uint64_t timestamp_;
+    std::uint32_t processId_;
+    Error error_;
+    int errorArgIndex_;
+    std::vector<std::string> args_;
+};
+
+/**
+ * @brief The AuditLog class appends a binary record of each parse's args and
+ *        outcome to a file, see ArgParser::SetAuditLog(...). The file is
+ *        opened with O_APPEND and each record is written with a single
+ *        write(2), so records from concurrent processes never interleave.
+ *        Records are decoded with Decode(...) or ReadFile(...).
+ *
+ * Record layout, every integer is a native endian uint32_t:
+ *   header { magic, size, timestampLow, timestampHigh, processId, error, errorArgIndex, argc }
+ *   args   { size, characters }[]
+ */
+class AuditLog {
+public:
+    explicit AuditLog(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        fd_ = ::_wopen(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+#endif
+    }
+
+    AuditLog(const AuditLog&) = delete;
+    AuditLog& operator=(const AuditLog&) = delete;
+
+    ~AuditLog()
+    {
+        if (fd_ >= 0) {
+#ifdef _WIN32
+            ::_close(fd_);
+#else
+            ::close(fd_);
+#endif
+        }
+    }
+
+    bool IsOpen() const
+    {
+        return fd_ >= 0;
+    }
+
+    /**
+     * Appends a record, returns false if it could not be written.
+     */
+    bool Append(int argc, char** argv, Error error, int errorArgIndex) const
+    {
+        if (fd_ < 0) {
+            return false;
+        }
+
+        std::size_t size = headerFields * sizeof(std::uint32_t);
+        for (int i = 0; i < argc; i++) {
+            size += sizeof(std::uint32_t) + std::strlen(argv[i]);
+        }
+        std::vector<char> record;
+        record.reserve(size);
+        auto timestamp = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        WriteUint32(record, magic);
+        WriteUint32(record, static_cast<std::uint32_t>(size));
+        WriteUint32(record, static_cast<std::uint32_t>(timestamp));
+        WriteUint32(record, static_cast<std::uint32_t>(timestamp >> 32));
+#ifdef _WIN32
+        WriteUint32(record, static_cast<std::uint32_t>(::_getpid()));
+#else
+        WriteUint32(record, static_cast<std::uint32_t>(::getpid()));
+#endif
+        WriteUint32(record, static_cast<std::uint32_t>(error));
+        WriteUint32(record, static_cast<std::uint32_t>(errorArgIndex));
+        WriteUint32(record, static_cast<std::uint32_t>(argc));
+        for (int i = 0; i < argc; i++) {
+            std::size_t length = std::strlen(argv[i]);
+            WriteUint32(record, static_cast<std::uint32_t>(length));
+            record.insert(record.end(), argv[i], argv[i] + length);
+        }
+
+#ifdef _WIN32
+        return ::_write(fd_, record.data(), static_cast<unsigned>(record.size())) == static_cast<int>(record.size());
+#else
+        ssize_t written;
+        do {
+            written = ::write(fd_, record.data(), record.size());
+        } while (written < 0 && errno == EINTR);
+        return written == static_cast<ssize_t>(record.size());
+#endif
+    }
+
+    /**
+     * Decodes every whole record in data, stopping at the first record that
+     * is truncated or corrupt.
+     */
+    static std::vector<AuditRecord> Decode(std::string_view data)
+    {
+        std::vector<AuditRecord> records;
+        const std::size_t headerSize = headerFields * sizeof(std::uint32_t);
+        for (std::size_t offset = 0; data.size() - offset >= headerSize;) {
+            const char* header = data.data() + offset;
+            auto field = [&](std::size_t index){ return ReadUint32(header + index * sizeof(std::uint32_t)); };
+            const std::size_t size = field(1);
+            if (field(0) != magic || size < headerSize || size > data.size() - offset) {
+                break;
+            }
+
+            AuditRecord record{ field(2) | (static_cast<std::uint64_t>(field(3)) << 32), field(4), static_cast<Error>(field(5)), static_cast<int>(field(6)), {} };
+            const std::uint32_t argc = field(7);
+            std::size_t argOffset = headerSize;
+            bool valid = true;
+            for (std::uint32_t i = 0; i < argc && valid; i++) {
+                if (size - argOffset < sizeof(std::uint32_t)) {
+                    valid = false;
+                    break;
+                }
+                std::size_t length = ReadUint32(header + argOffset);
+                argOffset += sizeof(std::uint32_t);
+                if (size - argOffset < length) {
+                    valid = false;
+                    break;
+                }
+                record.args_.emplace_back(header + argOffset, length);
+                argOffset += length;
+            }
+            if (!valid || argOffset != size) {
+                break;
+            }
+            records.push_back(std::move(record));
+            offset += size;
+        }
+        return records;
+    }
+
+    static std::vector<AuditRecord> ReadFile(const std::filesystem::path& path)
+    {
+        MappedFile file(path);
+        return Decode(std::string_view(file.GetData(), file.GetSize()));
+    }
+
+private:
+    static constexpr std::uint32_t magic = 0x4C415A45; // "EZAL"
+    static constexpr std::size_t headerFields = 8;
+
+    int fd_ = -1;
+};
+
+/**
+ * @brief The AliasTrie class indexes dotted aliases, e.g. "db.pool.size", one
+ *        node per segment, so a path is resolved in a single walk, and every
+ *        Option below a prefix can be listed, e.g. for help on a subtree.
+ *        Children are kept sorted by segment and found by binary search.
+ */
+class AliasTrie {
+public:
+    void Clear()
+    {
+        nodes_.clear();
+        nodes_.shrink_to_fit();
+    }
+
+    void Insert(std::string_view path, unsigned optionIndex)
+    {
+        if (nodes_.empty()) {
+            nodes_.emplace_back();
+        }
+        std::uint32_t node = 0;
+        ForEachSegment(path, [&](std::string_view segment)
+        {
+            auto& children = nodes_[node].children_;
+            auto child = LowerBound(children, segment);
+            if (child == children.end() || child->first != segment) {
+                child = children.insert(child, { std::string(segment), static_cast<std::uint32_t>(nodes_.size()) });
+                node = child->second;
+                nodes_.emplace_back();
+            } else {
+                node = child->second;
+            }
+            return true;
+        });
+        nodes_[node].option_ = optionIndex;
+    }
+
+    std::optional<unsigned> Find(std::string_view path) const
+    {
+        if (nodes_.empty()) {
+            return {};
+        }
+        std::uint32_t node = 0;
+        bool found = ForEachSegment(path, [&](std::string_view segment)
+        {
+            const auto& children = nodes_[node].children_;
+            auto child = LowerBound(children, segment);
+            if (child == children.end() || child->first != segment) {
+                return false;
+            }
+            node = child->second;
+            return true;
+        });
+        return found ? nodes_[node].option_ : std::nullopt;
+    }
+
+    /**
+     * Returns the sorted indexes of every Option at or below the pattern, in
+     * which a "*" segment matches any one segment, e.g. "db.*.size". An empty
+     * pattern matches every Option.
+     */
+    std::vector<unsigned> FindSubtree(std::string_view pattern) const
+    {
+        std::vector<std::string_view> segments;
+        if (!pattern.empty()) {
+            ForEachSegment(pattern, [&](std::string_view segment){ segments.push_back(segment); return true; });
+        }
+        std::vector<unsigned> optionIndexes;
+        if (!nodes_.empty()) {
+            CollectSubtree(0, segments, 0, optionIndexes);
+        }
+        std::sort(optionIndexes.begin(), optionIndexes.end());
+        optionIndexes.erase(std::unique(optionIndexes.begin(), optionIndexes.end()), optionIndexes.end());
+        return optionIndexes;
+    }
+
+    std::size_t GetHeapBytes() const
+    {
+        std::size_t bytes = nodes_.capacity() * sizeof(Node);
+        for (const Node& node : nodes_) {
+            bytes += node.children_.capacity() * sizeof(Child);
+            for (const auto& [segment, child] : node.children_) {
+                (void) child;
+                bytes += StringHeapBytes(segment);
+            }
+        }
+        return bytes;
+    }
+
+private:
+    using Child = std::pair<std::string, std::uint32_t>;
+
+    struct Node {
+        std::vector<Child> children_;
+        std::optional<unsigned> option_;
+    };
+
+    std::vector<Node> nodes_;
+
+    template <typename Children>
+    static auto LowerBound(Children& children, std::string_view segment) -> decltype(children.begin())
+    {
+        return std::lower_bound(children.begin(), children.end(), segment, [](const Child& child, std::string_view value){ return std::string_view(child.first) < value; });
+    }
+
+    template <typename Func>
+    static bool ForEachSegment(std::string_view path, Func&& func)
+    {
+        for (std::size_t first = 0;;) {
+            std::size_t last = std::min(path.find('.', first), path.size());
+            if (!func(path.substr(first, last - first))) {
+                return false;
+            }
+            if (last == path.size()) {
+                return true;
+            }
+            first = last + 1;
+        }
+    }
+
+    void CollectSubtree(std::uint32_t node, const std::vector<std::string_view>& segments, std::size_t depth, std::vector<unsigned>& optionIndexes) const
+    {
+        if (depth == segments.size()) {
+            if (nodes_[node].option_) {
+                optionIndexes.push_back(nodes_[node].option_.value());
+            }
+            for (const auto& [segment, child] : nodes_[node].children_) {
+                (void) segment;
+                CollectSubtree(child, segments, depth, optionIndexes);
+            }
+        } else if (segments[depth] == "*") {
+            for (const auto& [segment, child] : nodes_[node].children_) {
+                (void) segment;
+                CollectSubtree(child, segments, depth + 1, optionIndexes);
+            }
+        } else {
+            const auto& children = nodes_[node].children_;
+            auto child = LowerBound(children, segments[depth]);
+            if (child != children.end() && child->first == segments[depth]) {
+                CollectSubtree(child->second, segments, depth + 1, optionIndexes);
+            }
+        }
+    }
+};
+
+/**
+ * @brief The ArgvBuffer class builds a command line programmatically, storing
+ *        every arg in one contiguous block of NUL terminated strings with an
+ *        array of pointers into it. Argv() can be passed straight to
+ *        ArgParser::ParseArgs(...) or execve(...). Reset() empties the buffer
+ *        but keeps its memory, so reusing a buffer for each command line
+ *        doesn't allocate once it has grown large enough.
+ */
+class ArgvBuffer {
+public:
+    ArgvBuffer() = default;
+
+    ArgvBuffer(std::initializer_list<std::string_view> args)
+    {
+        for (std::string_view arg : args) {
+            Append(arg);
+        }
+    }
+
+    ArgvBuffer(const ArgvBuffer& other)
+        : bytes_(other.bytes_)
+        , offsets_(other.offsets_)
+    {}
+
+    ArgvBuffer& operator=(const ArgvBuffer& other)
+    {
+        bytes_ = other.bytes_;
+        offsets_ = other.offsets_;
+        pointers_.clear();
+        return *this;
+    }
+
+    /**
+     * Moving a vector keeps its storage, so the moved pointers still point
+     * into the moved bytes. other is left empty.
+     */
+    ArgvBuffer(ArgvBuffer&& other) noexcept
+        : bytes_(std::move(other.bytes_))
+        , offsets_(std::move(other.offsets_))
+        , pointers_(std::move(other.pointers_))
+    {
+        other.Reset();
+    }
+
+    ArgvBuffer& operator=(ArgvBuffer&& other) noexcept
+    {
+        if (this != &other) {
+            bytes_ = std::move(other.bytes_);
+            offsets_ = std::move(other.offsets_);
+            pointers_ = std::move(other.pointers_);
+            other.Reset();
+        }
+        return *this;
+    }
+
+    /**
+     * Reserves space for argCount args totalling byteCount characters.
+     */
+    void Reserve(std::size_t argCount, std::size_t byteCount)
+    {
+        bytes_.reserve(byteCount + argCount);
+        offsets_.reserve(argCount);
+        pointers_.reserve(argCount + 1);
+    }
+
+    /**
+     * Appends an arg, which is truncated at any NUL character it contains.
+     */
+    void Append(std::string_view arg)
+    {
+        arg = arg.substr(0, arg.find('\0'));
+        offsets_.push_back(bytes_.size());
+        bytes_.insert(bytes_.end(), arg.cbegin(), arg.cend());
+        bytes_.push_back('\0');
+        pointers_.clear();
+    }
+
+    void Reset()
+    {
+        bytes_.clear();
+        offsets_.clear();
+        pointers_.clear();
+    }
+
+    int Argc() const
+    {
+        return static_cast<int>(offsets_.size());
+    }
+
+    /**
+     * Returns the args, followed by a nullptr as execve(...) requires. Valid
+     * until the buffer is next modified.
+     */
+    char** Argv()
+    {
+        if (pointers_.size() != offsets_.size() + 1) {
+            pointers_.clear();
+            for (std::size_t offset : offsets_) {
+                pointers_.push_back(bytes_.data() + offset);
+            }
+            pointers_.push_back(nullptr);
+        }
+        return pointers_.data();
+    }
+
+    std::string_view operator[](std::size_t index) const
+    {
+        return std::string_view(bytes_.data() + offsets_.at(index));
+    }
+
+private:
+    std::vector<char> bytes_;
+    std::vector<std::size_t> offsets_;
+    std::vector<char*> pointers_;
+};
+
+enum class DumpFormat {
+    KeyValue,
+    JsonLines,
+};
+
+/**
+ * @brief The DumpWriter class batches small writes to an ostream in a fixed
+ *        size buffer, writes too large for the buffer go straight through.
+ */
+class DumpWriter {
+public:
+    explicit DumpWriter(std::ostream& out)
+        : out_(out)
+    {}
+
+    ~DumpWriter()
+    {
+        Flush();
+    }
+
+    DumpWriter& operator<<(std::string_view str)
+    {
+        if (used_ + str.size() > buffer_.size()) {
+            Flush();
+            if (str.size() > buffer_.size()) {
+                out_.write(str.data(), static_cast<std::streamsize>(str.size()));
+                return *this;
+            }
+        }
+        std::copy(str.cbegin(), str.cend(), buffer_.begin() + static_cast<std::ptrdiff_t>(used_));
+        used_ += str.size();
+        return *this;
+    }
+
+    DumpWriter& operator<<(char c)
+    {
+        return *this << std::string_view(&c, 1);
+    }
+
+    DumpWriter& operator<<(int value)
+    {
+        std::array<char, 16> digits;
+        auto [end, error] = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+        (void) error;
+        return *this << std::string_view(digits.data(), static_cast<std::size_t>(end - digits.data()));
+    }
+
+    /**
+     * Writes the string as a KeyValue dump value, so it can't be mistaken for
+     * the separators around it. A backslash is written before any '\\', '='
+     * or ' ', and control characters are written as a backslash followed by
+     * 'n', 't', 'r', or 'x' and two hex digits.
+     */
+    void WriteKeyValueEscaped(std::string_view str)
+    {
+        std::size_t first = 0;
+        for (std::size_t i = 0; i < str.size(); i++) {
+            auto c = static_cast<unsigned char>(str[i]);
+            if (c == '\\' || c == '=' || c == ' ' || c < 0x20 || c == 0x7F) {
+                *this << str.substr(first, i - first);
+                if (c == '\n') {
+                    *this << "\\n";
+                } else if (c == '\t') {
+                    *this << "\\t";
+                } else if (c == '\r') {
+                    *this << "\\r";
+                } else if (c < 0x20 || c == 0x7F) {
+                    const char* hex = "0123456789abcdef";
+                    *this << "\\x" << hex[c >> 4] << hex[c & 0xF];
+                } else {
+                    *this << '\\' << static_cast<char>(c);
+                }
+                first = i + 1;
+            }
+        }
+        *this << str.substr(first);
+    }
+
+    /**
+     * Writes the string as the contents of a JSON string, escaping as needed.
+     */
+    void WriteJsonEscaped(std::string_view str)
+    {
+        std::size_t first = 0;
+        for (std::size_t i = 0; i < str.size(); i++) {
+            auto c = static_cast<unsigned char>(str[i]);
+            if (c == '"' || c == '\\' || c < 0x20) {
+                *this << str.substr(first, i - first);
+                if (c == '"' || c == '\\') {
+                    *this << '\\' << static_cast<char>(c);
+                } else {
+                    const char* hex = "0123456789abcdef";
+                    *this << "\\u00" << hex[c >> 4] << hex[c & 0xF];
+                }
+                first = i + 1;
+            }
+        }
+        *this << str.substr(first);
+    }
+
+    void Flush()
+    {
+        out_.write(buffer_.data(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+    }
+
+private:
+    std::ostream& out_;
+    std::array<char, 4096> buffer_;
+    std::size_t used_ = 0;
+};
+
+/**
+ * @brief The AppliedArg struct is an arg whose Option's action succeeded.
+ *
+ * @param index_ The index in argv of the arg.
+ *
+ * @param option_ The index of the Option, in the order they were set.
+ *
+ * @param parameter_ The parameter the action was passed, after environment
+ *                   expansion. Empty if there was none, or if the action took
+ *                   ownership of it, see OptionAction::TakesOwnership().
+ */
+struct AppliedArg {
+    int index_;
+    unsigned option_;
+    std::optional<std::string> parameter_;
+};
+
+/**
+ * @brief The ParseResult struct holds the state of a single parse, so a const
+ *        ArgParser can parse on several threads at once, each into its own
+ *        ParseResult. Keep it for DumpConfiguration(...) after the parse.
+ *
+ * @param args_ The args whose Option's action succeeded, in the order given.
+ *
+ * @param errorCount_ The number of errors the parse reported, so callers can
+ *                    tell if it succeeded, e.g. before publishing its values,
+ *                    see ConfigSnapshots.
+ */
+struct ParseResult {
+    std::vector<AppliedArg> args_;
+    unsigned errorCount_ = 0;
+};
+
+/**
+ * @brief The ArgParser class is where the meat of this library is. It is
+ *        responsible for parsing the args, with the provided Options and
+ *        checking that the parsed args meet all of the provided Rules. It also
+ *        is responsible for ensuring that the Options provided are valid.
+ */
+class ArgParser {
+public:
+    ArgParser(ArgsParser&& argsParser)
+        : ArgParser(GetDefaultErrorHandler(), std::move(argsParser))
+    {}
+    ArgParser(ArgsTokeniser&& argsTokeniser)
+        : ArgParser(GetDefaultErrorHandler(), std::move(argsTokeniser))
+    {}
+    /**
+     * An ArgsParser doesn't pass the arg index of its errors, so they are
+     * audited with the index -1.
+     */
+    ArgParser(ErrorHandler&& errorHandler, ArgsParser&& argsParser)
+        : ArgParser(std::move(errorHandler), [argsParser = std::move(argsParser)](int argc, char** argv, const ArgErrorHandler& errorFunc, const ValueCountLookup&)
+                    {
+                        return argsParser(argc, argv, [&](Error error, const std::string& where){ errorFunc(error, where, -1); });
+                    })
+    {}
+    ArgParser(ErrorHandler&& errorHandler = GetDefaultErrorHandler(), ArgsTokeniser&& argsTokeniser = GetDefaultPosixArgsTokeniser())
+        : errorFunc_(std::move(errorHandler))
+        , argsTokeniser_(std::move(argsTokeniser))
     {}
 
     void SetOptions(std::vector<Option>&& options)
     {
-        options_ = std::move(options);
-        aliasMap_.clear();
+        options_ = std::move(options);
+        aliasMap_.clear();
+        aliasTrie_.Clear();
+        schema_.reset();
+        validators_.clear();
+
+        for (unsigned currentIndex = 0; currentIndex < options_.size(); currentIndex++) {
+            IndexOption(currentIndex);
+        }
+    }
+
+    /**
+     * Appends Options to those already set, only the new Options are checked
+     * and indexed. Not supported when using a CompiledSchema.
+     */
+    void AddOptions(std::vector<Option>&& options)
+    {
+        AppendOptions(std::move(options));
+    }
+
+    /**
+     * Sets a resolver to be tried by ResolveAliases(...) for any alias that
+     * matches no Option, so plugins can be loaded only when their aliases are
+     * used. Pass nullptr to disable.
+     */
+    void SetAliasResolver(AliasResolver resolver)
+    {
+        resolver_ = std::move(resolver);
+    }
+
+    /**
+     * Calls the AliasResolver once for each distinct alias in the args, from
+     * Tokenise(...), which matches no Option, and adds the Options it returns
+     * as if by AddOptions(...). Pass the same args on to ParseArgs(...), which
+     * never changes the Options so can be called from several threads at once.
+     * Errors in the args are left for ParseArgs(...) to report.
+     */
+    void ResolveAliases(const TokenisedArgs& tokenisedArgs)
+    {
+        if (!resolver_) {
+            return;
+        }
+        std::set<std::string> tried;
+        for (const auto& [index, alias, parameter] : tokenisedArgs.parsedArgs_) {
+            (void) index; // unused
+            (void) parameter; // unused
+            if (!FindOption(alias) && tried.insert(alias).second) {
+                AppendOptions(resolver_(alias));
+            }
+        }
+    }
+
+    /**
+     * Uses a CompiledSchema for alias lookups, help text and parameter
+     * requirements instead of building them. The actions are bound in the
+     * same order as the Options the schema was compiled from, and must have
+     * matching parameter requirements. The schema's Validators are compiled.
+     */
+    void SetOptions(const CompiledSchema& schema, std::vector<OptionAction>&& actions)
+    {
+        options_.clear();
+        aliasMap_.clear();
+        aliasTrie_.Clear();
+        schema_.reset();
+        validators_.clear();
+
+        if (!schema.IsValid()) {
+            errorFunc_(Error::InvalidCompiledSchema, "Compiled schema header or offsets are invalid.");
+            return;
+        }
+        if (schema.OptionCount() != actions.size()) {
+            errorFunc_(Error::InvalidCompiledSchema, "Compiled schema has " + std::to_string(schema.OptionCount()) + " Options but " + std::to_string(actions.size()) + " actions were bound.");
+            return;
+        }
+
+        schema_ = schema;
+        options_.reserve(actions.size());
+        validators_.reserve(actions.size());
+        for (unsigned currentIndex = 0; currentIndex < actions.size(); currentIndex++) {
+            options_.push_back({ "", std::move(actions[currentIndex]), "", schema.GetValidators(currentIndex) });
+            const auto& option = options_.back();
+
+            validators_.emplace_back();
+            for (const Validator& validator : option.validators_) {
+                if (auto compiled = CompiledValidator::Compile(validator)) {
+                    validators_.back().push_back(std::move(compiled.value()));
+                } else {
+                    errorFunc_(Error::InvalidValidator, "Compiled schema Option " + std::to_string(currentIndex) + " { " + std::string(schema.GetAliases(currentIndex)) + " }");
+                }
+            }
+
+            if (option.onParse_.GetAction() == nullptr) {
+                errorFunc_(Error::NullOptionAction, "Compiled schema Option " + std::to_string(currentIndex) + " { " + std::string(schema.GetAliases(currentIndex)) + " }");
+            }
+            if (option.onParse_.GetParameterRequirements() != schema.GetParameterRequirements(currentIndex)) {
+                errorFunc_(Error::InvalidCompiledSchema, "Compiled schema Option " + std::to_string(currentIndex) + " { " + std::string(schema.GetAliases(currentIndex)) + " } parameter requirements differ from its action.");
+            }
+
+            // Lookups use the schema, the trie is only needed for namespace help
+            for (const auto& alias : ParseAliases(std::string(schema.GetAliases(currentIndex)))) {
+                if (alias.find('.') != alias.npos && schema.Find(alias) == currentIndex) {
+                    aliasTrie_.Insert(alias, currentIndex);
+                }
+            }
+        }
+    }
+
+    /**
+     * Serialises the alias index and the aliases, help text, parameter
+     * requirements and Validators of each Option into a position independent
+     * blob, see CompiledSchema. Actions are not included.
+     */
+    std::vector<char> CompileSchema() const
+    {
+        std::vector<std::pair<std::string, unsigned>> aliases;
+        for (unsigned optionIndex = 0; optionIndex < options_.size(); optionIndex++) {
+            for (const auto& alias : ParseAliases(std::string(GetAliases(optionIndex)))) {
+                if (FindOption(alias) == optionIndex) {
+                    aliases.push_back({ alias, optionIndex });
+                }
+            }
+        }
+        std::sort(aliases.begin(), aliases.end());
+        std::size_t validatorCount = 0;
+        for (const Option& option : options_) {
+            validatorCount += option.validators_.size();
+        }
+
+        const std::size_t tablesSize = (CompiledSchema::headerFields + options_.size() * CompiledSchema::optionFields + aliases.size() * CompiledSchema::aliasFields + validatorCount * CompiledSchema::validatorFields) * sizeof(std::uint32_t);
+        std::string strings;
+        auto addString = [&](std::string_view str) -> std::pair<std::uint32_t, std::uint32_t>
+        {
+            auto offset = static_cast<std::uint32_t>(tablesSize + strings.size());
+            strings.append(str);
+            return { offset, static_cast<std::uint32_t>(str.size()) };
+        };
+
+        std::vector<char> tables;
+        std::uint32_t firstValidator = 0;
+        for (unsigned optionIndex = 0; optionIndex < options_.size(); optionIndex++) {
+            auto [aliasesOffset, aliasesSize] = addString(GetAliases(optionIndex));
+            auto [helpOffset, helpSize] = addString(GetHelpText(optionIndex));
+            const auto optionValidators = static_cast<std::uint32_t>(options_[optionIndex].validators_.size());
+            WriteUint32(tables, aliasesOffset);
+            WriteUint32(tables, aliasesSize);
+            WriteUint32(tables, helpOffset);
+            WriteUint32(tables, helpSize);
+            WriteUint32(tables, static_cast<std::uint32_t>(options_[optionIndex].onParse_.GetParameterRequirements()));
+            WriteUint32(tables, firstValidator);
+            WriteUint32(tables, optionValidators);
+            firstValidator += optionValidators;
+        }
+        for (const auto& [alias, optionIndex] : aliases) {
+            auto [aliasOffset, aliasSize] = addString(alias);
+            WriteUint32(tables, aliasOffset);
+            WriteUint32(tables, aliasSize);
+            WriteUint32(tables, optionIndex);
+        }
+        for (const Option& option : options_) {
+            for (const Validator& validator : option.validators_) {
+                auto [patternOffset, patternSize] = addString(validator.pattern_);
+                WriteUint32(tables, static_cast<std::uint32_t>(validator.kind_));
+                WriteDouble(tables, validator.min_);
+                WriteDouble(tables, validator.max_);
+                WriteUint32(tables, patternOffset);
+                WriteUint32(tables, patternSize);
+            }
+        }
+
+        std::vector<char> blob;
+        blob.reserve(tablesSize + strings.size());
+        WriteUint32(blob, CompiledSchema::magic);
+        WriteUint32(blob, CompiledSchema::version);
+        WriteUint32(blob, static_cast<std::uint32_t>(options_.size()));
+        WriteUint32(blob, static_cast<std::uint32_t>(aliases.size()));
+        WriteUint32(blob, static_cast<std::uint32_t>(validatorCount));
+        WriteUint32(blob, static_cast<std::uint32_t>(tablesSize));
+        WriteUint32(blob, static_cast<std::uint32_t>(tablesSize + strings.size()));
+        blob.insert(blob.end(), tables.begin(), tables.end());
+        blob.insert(blob.end(), strings.begin(), strings.end());
+        return blob;
+    }
+
+    /**
+     * Enables an AuditLog, a record of the args and the outcome of every
+     * ParseArgs(...) is appended to it. Pass nullptr to disable.
+     */
+    void SetAuditLog(std::shared_ptr<const AuditLog> auditLog)
+    {
+        auditLog_ = std::move(auditLog);
+    }
+
+    /**
+     * Enables expansion of environment variables within parameters before they
+     * are passed to an Option's action, see ExpandEnvironment(...). Parameters
+     * without a "$" are passed through untouched. Pass nullptr to disable.
+     */
+    void SetEnvironmentExpansion(std::shared_ptr<const EnvironmentSnapshot> environment)
+    {
+        environment_ = std::move(environment);
+    }
+
+    void SetRules(std::vector<Rule>&& rules)
+    {
+        rules_ = std::move(rules);
+    }
+
+    /**
+     * Constraints are checked at the end of ParseArgs(...), after every action
+     * has run. A Constraint is skipped if any of its Options failed to parse,
+     * every other violated Constraint is reported. Call after SetOptions(...),
+     * a Constraint naming an alias with no Option is reported and dropped.
+     */
+    void SetConstraints(std::vector<Constraint>&& constraints)
+    {
+        constraints_.clear();
+        for (Constraint& constraint : constraints) {
+            bool valid = true;
+            for (const auto& alias : constraint.aliases_) {
+                if (!FindOption(alias)) {
+                    errorFunc_(Error::UnrecognisedAlias, "Constraint " + PrintVector(constraint.aliases_) + " has no Option \"" + alias + "\"");
+                    valid = false;
+                }
+            }
+            if (valid) {
+                constraints_.push_back(std::move(constraint));
+            }
+        }
+    }
+
+    void PrintHelpTable(std::ostream& out = std::cout, std::string additionalHelpText = "") const
+    {
+        std::vector<unsigned> optionIndexes(options_.size());
+        std::iota(optionIndexes.begin(), optionIndexes.end(), 0u);
+        out << FormatHelpTable(optionIndexes);
+        out << std::endl << additionalHelpText << std::endl << std::endl;
+    }
+
+    /**
+     * Prints the help table for the Options in a namespace of dotted aliases,
+     * e.g. "db.pool" for "db.pool.size" and "db.pool.timeout". A "*" segment
+     * matches any one segment, e.g. "db.*.timeout".
+     *
+     * @return false if no Options are in the namespace.
+     */
+    bool PrintHelpTableFor(std::string_view subtree, std::ostream& out = std::cout) const
+    {
+        std::vector<unsigned> optionIndexes = aliasTrie_.FindSubtree(subtree);
+        if (optionIndexes.empty()) {
+            return false;
+        }
+        out << FormatHelpTable(optionIndexes) << std::endl;
+        return true;
+    }
+
+    /**
+     * Estimates the memory held by this parser, see MemoryFootprint. Nothing
+     * is retained between parses, so this doesn't change when args are
+     * parsed. A CompiledSchema is not owned by the parser, so is not counted.
+     */
+    MemoryFootprint GetMemoryFootprint() const
+    {
+        MemoryFootprint footprint;
+
+        footprint.options_ = options_.capacity() * sizeof(Option);
+        for (const auto& option : options_) {
+            footprint.options_ += StringHeapBytes(option.aliases_) + StringHeapBytes(option.helpText_) + option.validators_.capacity() * sizeof(Validator);
+            for (const auto& validator : option.validators_) {
+                footprint.options_ += StringHeapBytes(validator.pattern_);
+            }
+        }
+
+        footprint.validators_ = validators_.capacity() * sizeof(std::vector<CompiledValidator>);
+        for (const auto& compiledValidators : validators_) {
+            footprint.validators_ += compiledValidators.capacity() * sizeof(CompiledValidator);
+            for (const auto& compiled : compiledValidators) {
+                footprint.validators_ += compiled.GetMemoryFootprint();
+            }
+        }
+
+        for (const auto& [alias, index] : aliasMap_) {
+            (void) index;
+            footprint.aliasIndex_ += mapNodeOverhead + sizeof(std::pair<const std::string, unsigned>) + StringHeapBytes(alias);
+        }
+        footprint.aliasTrie_ = aliasTrie_.GetHeapBytes();
+
+        footprint.rules_ = rules_.capacity() * sizeof(Rule);
+
+        footprint.constraints_ = constraints_.capacity() * sizeof(Constraint);
+        for (const auto& constraint : constraints_) {
+            footprint.constraints_ += constraint.aliases_.capacity() * sizeof(std::string);
+            for (const auto& alias : constraint.aliases_) {
+                footprint.constraints_ += StringHeapBytes(alias);
+            }
+        }
+
+        footprint.resolver_ = resolver_ ? sizeof(AliasResolver) : 0;
+        footprint.environment_ = environment_ ? sizeof(EnvironmentSnapshot) + environment_->GetHeapBytes() : 0;
+
+        return footprint;
+    }
+
+    /**
+     * ParseArgs parses the arguments in the order they were specified on the
+     * comand line. Once an option has been actioned, it will not be actioned
+     * again, even if a different alias for the same option was used or a
+     * different parameter value was provided.
+     *
+     * @param argc The number of string arguments, take this unmodified from
+     *             main.
+     *
+     * @param argv The string arguments to parse, take this unmodified from
+     *             main.
+     *
+     * @param parser By default assumes a Posix style "-n" for short args,
+     *               "--name" for long args and all space seperated strings
+     *               after a plain "--" are considered positional arguments. See
+     *               "SetCommandLineParser(...)" for custom behaviour.
+     *
+     * @return Any positional arguments.
+     */
+    std::vector<std::string> ParseArgs(int argc, char** argv) const
+    {
+        ParseResult result;
+        return ParseArgs(argc, argv, result);
+    }
+
+    /**
+     * Parses the args as ParseArgs(argc, argv) does, keeping the state of
+     * the parse in resultOut, e.g. for DumpConfiguration(...).
+     */
+    std::vector<std::string> ParseArgs(int argc, char** argv, ParseResult& resultOut) const
+    {
+        resultOut = ParseResult();
+        const ParseContext context{ argc, argv, resultOut };
+        auto [parsedArgs, tokenisedPositionalArgs] = Tokenise(context);
+        std::vector<std::string> positionalArgs = ParseTokenised(context, parsedArgs, tokenisedPositionalArgs);
+        AuditSuccess(context);
+        return positionalArgs;
+    }
+
+    /**
+     * Parses args already tokenised by Tokenise(...), e.g. args that have
+     * been pre-parsed by another ArgParser with ParseKnownArgs(...). The
+     * tokenised args are not modified, so can be shared by several parses,
+     * each parameter is copied only as it is passed to its action. Errors
+     * found while tokenising are reported first, by every parse.
+     */
+    std::vector<std::string> ParseArgs(int argc, char** argv, const TokenisedArgs& tokenisedArgs) const
+    {
+        ParseResult result;
+        return ParseArgs(argc, argv, tokenisedArgs, result);
+    }
+
+    std::vector<std::string> ParseArgs(int argc, char** argv, const TokenisedArgs& tokenisedArgs, ParseResult& resultOut) const
+    {
+        resultOut = ParseResult();
+        const ParseContext context{ argc, argv, resultOut };
+        for (const auto& [error, where, argIndex] : tokenisedArgs.errors_) {
+            ReportError(context, error, where, argIndex);
+        }
+        std::vector<std::string> positionalArgs = ParseTokenised(context, tokenisedArgs.parsedArgs_, tokenisedArgs.positionalArgs_);
+        AuditSuccess(context);
+        return positionalArgs;
+    }
+
+    /**
+     * Tokenises the args with this parser's ArgsTokeniser, so they can be passed
+     * to ParseKnownArgs(...) and ParseArgs(...) without being tokenised again.
+     * Options unknown to this parser may be known to the parser the args are
+     * passed to, so every value following their aliases is kept with them.
+     * Errors are not reported here, they are kept with the tokenised args.
+     */
+    TokenisedArgs Tokenise(int argc, char** argv) const
+    {
+        TokenisedArgs tokenisedArgs;
+        std::tie(tokenisedArgs.parsedArgs_, tokenisedArgs.positionalArgs_) = argsTokeniser_(argc, argv, [&](Error error, const std::string& where, int argIndex)
+        {
+            tokenisedArgs.errors_.push_back({ error, where, argIndex });
+        }, [this](const std::string& alias){ return MaxValues(alias, std::numeric_limits<unsigned>::max()); });
+        return tokenisedArgs;
+    }
+
+    /**
+     * Pre-parses a few bootstrap Options, e.g. "--config" or "--plugin-dir",
+     * which are needed before the full set of Options can be created. Args
+     * matching an Option are actioned as ParseArgs(...) would, any other args
+     * are skipped without errors or allocations. Rules are not checked and
+     * the AliasResolver is not used, as they apply to the full set of Options.
+     * The same tokenised args can then be passed on to the full parse, which
+     * writes the only audit record for the invocation.
+     */
+    void ParseKnownArgs(int argc, char** argv, const TokenisedArgs& tokenisedArgs) const
+    {
+        ParseResult result;
+        const ParseContext context{ argc, argv, result, false };
+        for (const auto& [index, alias, parameter] : tokenisedArgs.parsedArgs_) {
+            if (auto aliasIndex = FindOption(alias)) {
+                RunOption(context, index, aliasIndex.value(), parameter);
+            }
+        }
+    }
+
+    /**
+     * Writes a line per Option with its value and source from the parse that
+     * filled result, for logging the effective configuration. The Option is
+     * named by its longest alias. The value is the parameter of the last arg
+     * to specify the Option whose action succeeded, the source is
+     * "argv[index]" of that arg, or "default" if there was no such arg. Values
+     * are written through a fixed size buffer.
+     *
+     * DumpFormat::KeyValue writes "name=value\t# source", or "name\t# source"
+     * if there was no parameter, see DumpWriter::WriteKeyValueEscaped(...).
+     * Multiple values are separated by spaces.
+     *
+     * DumpFormat::JsonLines writes an object per line,
+     * {"option":"name","aliases":"n,name","value":"value","source":"argv[1]"}
+     * with a null value if there was no parameter. The value of an Option
+     * taking more than one value, see OptionAction::WithArity(...), is an
+     * array of strings, e.g. "value":["a b","c"].
+     *
+     * Parameters moved out of the parse, see MoveValue(...), are written as if
+     * there was no parameter, with a source of "argv[index] (moved)".
+     */
+    void DumpConfiguration(const ParseResult& result, std::ostream& out, DumpFormat format = DumpFormat::KeyValue) const
+    {
+        std::vector<const AppliedArg*> lastArgs(options_.size(), nullptr);
+        for (const auto& appliedArg : result.args_) {
+            lastArgs[appliedArg.option_] = &appliedArg;
+        }
+
+        DumpWriter writer(out);
+        for (unsigned optionIndex = 0; optionIndex < options_.size(); optionIndex++) {
+            std::string_view aliases = GetAliases(optionIndex);
+            std::string_view name;
+            for (std::size_t first = 0; first <= aliases.size();) {
+                std::size_t last = std::min(aliases.find(',', first), aliases.size());
+                if (last - first > name.size()) {
+                    name = aliases.substr(first, last - first);
+                }
+                first = last + 1;
+            }
+
+            const AppliedArg* lastArg = lastArgs[optionIndex];
+            const bool moved = lastArg && options_[optionIndex].onParse_.TakesOwnership();
+            const std::optional<std::string>* value = lastArg && !moved ? &lastArg->parameter_ : nullptr;
+            auto writeSource = [&]()
+            {
+                if (lastArg) {
+                    writer << "argv[" << lastArg->index_ << ']' << (moved ? " (moved)" : "");
+                } else {
+                    writer << "default";
+                }
+            };
+
+            if (format == DumpFormat::JsonLines) {
+                writer << "{\"option\":\"";
+                writer.WriteJsonEscaped(name);
+                writer << "\",\"aliases\":\"";
+                writer.WriteJsonEscaped(aliases);
+                writer << "\",\"value\":";
+                if (value && value->has_value() && options_[optionIndex].onParse_.GetMaxValues() > 1) {
+                    writer << '[';
+                    ForEachValue(value->value(), [&, first = true](std::string_view part) mutable
+                    {
+                        writer << (first ? "\"" : ",\"");
+                        writer.WriteJsonEscaped(part);
+                        writer << '"';
+                        first = false;
+                    });
+                    writer << ']';
+                } else if (value && value->has_value()) {
+                    writer << '"';
+                    writer.WriteJsonEscaped(value->value());
+                    writer << '"';
+                } else {
+                    writer << "null";
+                }
+                writer << ",\"source\":\"";
+                writeSource();
+                writer << "\"}\n";
+            } else {
+                writer << name;
+                if (value && value->has_value()) {
+                    writer << '=';
+                    ForEachValue(value->value(), [&, first = true](std::string_view part) mutable
+                    {
+                        writer << (first ? "" : " ");
+                        writer.WriteKeyValueEscaped(part);
+                        first = false;
+                    });
+                }
+                writer << "\t# ";
+                writeSource();
+                writer << '\n';
+            }
+        }
+    }
+
+    /**
+     * Parses the args exactly as ParseArgs(argc, argv) does, and also returns
+     * a compact copy of the applied args, see ParseResult, and the positional
+     * args, with every string interned in the pool. Args which were
+     * unrecognised or rejected are reported as usual and left out of the
+     * result.
+     */
+    InternedParseResult ParseArgs(int argc, char** argv, StringPool& pool) const
+    {
+        ParseResult parse;
+        InternedParseResult result;
+        std::vector<std::string> positionalArgs = ParseArgs(argc, argv, parse);
+        result.positionalArgs_.reserve(positionalArgs.size());
+        for (const auto& positionalArg : positionalArgs) {
+            result.positionalArgs_.push_back(pool.Intern(positionalArg));
+        }
+        result.args_.reserve(parse.args_.size());
+        for (const auto& [index, optionIndex, parameter] : parse.args_) {
+            result.args_.push_back({ index, optionIndex, parameter ? pool.Intern(parameter.value()) : std::string_view() });
+        }
+        return result;
+    }
+
+private:
+    const ErrorHandler errorFunc_;
+    const ArgsTokeniser argsTokeniser_;
+
+    std::vector<Option> options_;
+    //              <   alias   ,  index  >
+    std::map<std::string, unsigned> aliasMap_;
+    // Dotted aliases only, e.g. "db.pool.size"
+    AliasTrie aliasTrie_;
+    // Indexed the same as options_
+    std::vector<std::vector<CompiledValidator>> validators_;
+    AliasResolver resolver_;
+
+    std::vector<Rule> rules_;
+    std::vector<Constraint> constraints_;
+    std::optional<CompiledSchema> schema_;
+    std::shared_ptr<const EnvironmentSnapshot> environment_;
+    std::shared_ptr<const AuditLog> auditLog_;
+
+    // The state of a single call to ParseArgs(...)
+    struct ParseContext {
+        int argc_;
+        char** argv_;
+        ParseResult& result_;
+        // A pre-parse is part of the invocation audited by the full parse
+        bool audited_ = true;
+    };
+
+    void AppendOptions(std::vector<Option>&& options)
+    {
+        if (schema_) {
+            errorFunc_(Error::InvalidCompiledSchema, "Options cannot be added to a parser using a compiled schema.");
+            return;
+        }
+        options_.reserve(options_.size() + options.size());
+        for (auto& option : options) {
+            options_.push_back(std::move(option));
+            IndexOption(static_cast<unsigned>(options_.size() - 1));
+        }
+    }
 
-        for (unsigned currentIndex = 0; currentIndex < options_.size(); currentIndex++) {
-            const auto& option = options_[currentIndex];
+    void IndexOption(unsigned currentIndex)
+    {
+        validators_.emplace_back();
+        const auto& option = options_[currentIndex];
 
-            if (option.aliases_.empty()) {
-                errorFunc_(Error::OptionHasNoAliases, PointToOptions(options_, { currentIndex }));
+        for (const Validator& validator : option.validators_) {
+            if (auto compiled = CompiledValidator::Compile(validator)) {
+                validators_[currentIndex].push_back(std::move(compiled.value()));
+            } else {
+                errorFunc_(Error::InvalidValidator, PointToOptions(options_, { currentIndex }));
             }
+        }
 
-            if (option.onParse_.GetAction() == nullptr) {
-                errorFunc_(Error::NullOptionAction, PointToOptions(options_, { currentIndex }));
+        if (option.aliases_.empty()) {
+            errorFunc_(Error::OptionHasNoAliases, PointToOptions(options_, { currentIndex }));
+        }
+
+        if (option.onParse_.GetAction() == nullptr) {
+            errorFunc_(Error::NullOptionAction, PointToOptions(options_, { currentIndex }));
+        }
+
+        if (auto parameterPresence = option.onParse_.GetParameterRequirements(); parameterPresence != Parameter::None && parameterPresence != Parameter::Optional && parameterPresence != Parameter::Required) {
+            errorFunc_(Error::InvalidParameterEnumValue, PointToOptions(options_, { currentIndex }));
+        }
+
+        // Dotted aliases are only indexed by aliasTrie_, the rest only by aliasMap_
+        for (const auto& alias : ParseAliases(option.aliases_)) {
+            bool dotted = alias.find('.') != alias.npos;
+            if (auto existing = FindOption(alias)) {
+                errorFunc_(Error::AliasClash, PointToOptions(options_, { currentIndex, existing.value() }));
+            } else {
+                if (alias.empty() || (dotted && (alias.front() == '.' || alias.back() == '.' || alias.find("..") != alias.npos))) {
+                    errorFunc_(Error::EmptyAlias, PointToOptions(options_, { currentIndex }));
+                } else if (alias.find(' ') != alias.npos) {
+                    errorFunc_(Error::SpaceInAlias, PointToOptions(options_, { currentIndex }));
+                } else if (dotted) {
+                    aliasTrie_.Insert(alias, currentIndex);
+                } else {
+                    aliasMap_[alias] = currentIndex;
+                }
+            }
+        }
+    }
+
+    std::optional<unsigned> FindOption(const std::string& alias) const
+    {
+        if (schema_) {
+            return schema_->Find(alias);
+        } else if (alias.find('.') != alias.npos) {
+            return aliasTrie_.Find(alias);
+        } else if (auto iter = aliasMap_.find(alias); iter != aliasMap_.end()) {
+            return iter->second;
+        }
+        return {};
+    }
+
+    ParsedArgs Tokenise(const ParseContext& context) const
+    {
+        return argsTokeniser_(context.argc_, context.argv_, [&](Error error, const std::string& where, int argIndex){ ReportError(context, error, where, argIndex); }, [this](const std::string& alias){ return MaxValues(alias); });
+    }
+
+    unsigned MaxValues(const std::string& alias, unsigned unknownMaxValues = 1) const
+    {
+        auto optionIndex = FindOption(alias);
+        return optionIndex ? options_[optionIndex.value()].onParse_.GetMaxValues() : unknownMaxValues;
+    }
+
+    // Moves from tokens owned by the parse, copies tokens shared with the caller
+    template <typename T>
+    static T Take(T& owned)
+    {
+        return std::move(owned);
+    }
+
+    template <typename T>
+    static T Take(const T& shared)
+    {
+        return shared;
+    }
+
+    /**
+     * The args are either owned by the parse, and their parameters are moved
+     * to the actions, or const ones shared with the caller, which are copied.
+     */
+    template <typename Args, typename Positionals>
+    std::vector<std::string> ParseTokenised(const ParseContext& context, Args& parsedArgs, Positionals& positionalArgs) const
+    {
+        const ErrorHandler report = [&](Error error, const std::string& where){ ReportError(context, error, where, -1); };
+        for (const Rule& rule : rules_) {
+            rule(parsedArgs, report);
+        }
+        std::set<unsigned> failedOptions;
+        for (auto& [index, alias, parameter] : parsedArgs) {
+            if (auto aliasIndex = FindOption(alias)) {
+                if (!RunOption(context, index, aliasIndex.value(), Take(parameter))) {
+                    failedOptions.insert(aliasIndex.value());
+                }
+            } else {
+                ReportError(context, Error::UnrecognisedAlias, PointToArg(context.argc_, context.argv_, static_cast<int>(index)), index);
             }
+        }
+        CheckConstraints(context, failedOptions);
+        return Take(positionalArgs);
+    }
+
+    void ReportError(const ParseContext& context, Error error, const std::string& where, int argIndex) const
+    {
+        // Audited before the handler runs, as the default handler exits
+        if (context.result_.errorCount_++ == 0 && context.audited_ && auditLog_) {
+            auditLog_->Append(context.argc_, context.argv_, error, argIndex);
+        }
+        errorFunc_(error, where);
+    }
+
+    void AuditSuccess(const ParseContext& context) const
+    {
+        if (context.result_.errorCount_ == 0 && context.audited_ && auditLog_) {
+            auditLog_->Append(context.argc_, context.argv_, Error::None, -1);
+        }
+    }
 
-            if (auto parameterPresence = option.onParse_.GetParameterRequirements(); parameterPresence != Parameter::None && parameterPresence != Parameter::Optional && parameterPresence != Parameter::Required) {
-                errorFunc_(Error::InvalidParameterEnumValue, PointToOptions(options_, { currentIndex }));
+    bool RunOption(const ParseContext& context, int index, unsigned optionIndex, std::optional<std::string> parameter) const
+    {
+        if (environment_ && parameter && parameter->find('$') != std::string::npos) {
+            std::string expanded;
+            if (Error expansionError = ExpandEnvironment(parameter.value(), *environment_, expanded); expansionError != Error::None) {
+                ReportError(context, expansionError, PointToArg(context.argc_, context.argv_, index), index);
+                return false;
             }
+            parameter = std::move(expanded);
+        }
+        if (parameter && !CheckValueCount(context, index, optionIndex, parameter.value())) {
+            return false;
+        }
+        if (parameter && !PassesValidators(optionIndex, parameter.value())) {
+            ReportError(context, Error::ValidationFailed, PointToArg(context.argc_, context.argv_, index), index);
+            return false;
+        }
+        const OptionAction& onParse = options_.at(optionIndex).onParse_;
+        Error actionError = onParse.Invoke(parameter, index);
+        if (actionError != Error::None) {
+            ReportError(context, actionError, PointToArg(context.argc_, context.argv_, index), index);
+            return false;
+        }
+        // Only recorded once applied, so the result never shows a rejected value
+        context.result_.args_.push_back({ index, optionIndex, onParse.TakesOwnership() ? std::nullopt : std::move(parameter) });
+        return true;
+    }
 
-            for (const auto& alias : ParseAliases(option.aliases_)) {
-                if (aliasMap_.count(alias) > 0) {
-                    errorFunc_(Error::AliasClash, PointToOptions(options_, { currentIndex, aliasMap_.at(alias) }));
+    /**
+     * A single pass suffices, Constraints only read values the actions have
+     * already stored and never change them, so they don't depend on each
+     * other and reporting every violation makes their order irrelevant.
+     */
+    void CheckConstraints(const ParseContext& context, const std::set<unsigned>& failedOptions) const
+    {
+        for (const Constraint& constraint : constraints_) {
+            std::vector<unsigned> optionIndexes;
+            bool skip = false;
+            for (const auto& alias : constraint.aliases_) {
+                // The Options may have been replaced since SetConstraints(...)
+                if (auto optionIndex = FindOption(alias)) {
+                    optionIndexes.push_back(optionIndex.value());
+                    skip = skip || failedOptions.count(optionIndex.value()) > 0;
                 } else {
-                    if (alias.empty()) {
-                        errorFunc_(Error::EmptyAlias, PointToOptions(options_, { currentIndex }));
-                    } else if (alias.find(' ') != alias.npos) {
-                        errorFunc_(Error::SpaceInAlias, PointToOptions(options_, { currentIndex }));
-                    } else {
-                        aliasMap_[alias] = currentIndex;
-                    }
+                    ReportError(context, Error::UnrecognisedAlias, "Constraint " + PrintVector(constraint.aliases_) + " has no Option \"" + alias + "\"", -1);
+                    skip = true;
+                    break;
+                }
+            }
+            if (skip || constraint.check_()) {
+                continue;
+            }
+
+            std::vector<int> argIndexes;
+            for (const auto& [index, optionIndex, parameter] : context.result_.args_) {
+                (void) parameter; // unused
+                if (std::find(optionIndexes.cbegin(), optionIndexes.cend(), optionIndex) != optionIndexes.cend()) {
+                    argIndexes.push_back(index);
                 }
             }
+            if (argIndexes.empty()) {
+                ReportError(context, Error::ConstraintViolated, PointToOptions(options_, optionIndexes), -1);
+            } else {
+                ReportError(context, Error::ConstraintViolated, PointToArgs(context.argc_, context.argv_, argIndexes) + "\n" + PrintVector(constraint.aliases_), argIndexes.front());
+            }
         }
     }
 
-    void SetRules(std::vector<Rule>&& rules)
+    bool CheckValueCount(const ParseContext& context, int index, unsigned optionIndex, const std::string& parameter) const
     {
-        rules_ = std::move(rules);
+        const OptionAction& onParse = options_.at(optionIndex).onParse_;
+        // Args can't contain '\0', so each separator is exactly one more value
+        const auto valueCount = static_cast<unsigned>(std::count(parameter.cbegin(), parameter.cend(), '\0') + 1);
+        if (valueCount < onParse.GetMinValues() || valueCount > onParse.GetMaxValues()) {
+            ReportError(context, Error::WrongParameterCount, PointToArg(context.argc_, context.argv_, index), index);
+            return false;
+        }
+        return true;
     }
 
-    void PrintHelpTable(std::ostream& out = std::cout, std::string additionalHelpText = "") const
+    bool PassesValidators(unsigned optionIndex, std::string_view parameter) const
+    {
+        const auto& validators = validators_.at(optionIndex);
+        bool passes = true;
+        ForEachValue(parameter, [&](std::string_view value)
+        {
+            passes = passes && std::all_of(validators.cbegin(), validators.cend(), [&](const CompiledValidator& validator){ return validator.Check(value); });
+        });
+        return passes;
+    }
+
+    std::string_view GetAliases(unsigned optionIndex) const
+    {
+        return schema_ ? schema_->GetAliases(optionIndex) : std::string_view(options_[optionIndex].aliases_);
+    }
+
+    std::string_view GetHelpText(unsigned optionIndex) const
+    {
+        return schema_ ? schema_->GetHelpText(optionIndex) : std::string_view(options_[optionIndex].helpText_);
+    }
+
+    std::string FormatHelpTable(const std::vector<unsigned>& optionIndexes) const
     {
         // TODO a table is cute and all, but checkout https://stackoverflow.com/questions/9725675/is-there-a-standard-format-for-command-line-shell-help-text
 
@@ -564,78 +3011,417 @@ public:
             {Parameter::Optional, "Optional "},
             {Parameter::Required, "Required "},
         };
-        const unsigned paramColWidth = 9;
-        unsigned aliasColWidth = 0;
-        unsigned helpColWidth = 0;
-        for (const auto& [aliases, action, helpText] : options_) {
-            (void) action;
-            aliasColWidth = std::max(aliasColWidth, aliases.size());
-            helpColWidth = std::max(helpColWidth, helpText.size());
+        const std::size_t paramColWidth = 9;
+        std::size_t aliasColWidth = 0;
+        std::size_t helpColWidth = 0;
+        for (unsigned optionIndex : optionIndexes) {
+            aliasColWidth = std::max(aliasColWidth, GetAliases(optionIndex).size());
+            helpColWidth = std::max(helpColWidth, GetHelpText(optionIndex).size());
         }
 
+        std::stringstream out;
         std::string aliasTitle = "Aliases";
         std::string paramTitle = "Parameter";
         std::string helpTitle = "Usage";
+        aliasColWidth = std::max(aliasColWidth, aliasTitle.size());
+        helpColWidth = std::max(helpColWidth, helpTitle.size());
         out << " _" << std::string(aliasColWidth, '_') << "___"  << std::string(paramColWidth, '_') << "___"  << std::string(helpColWidth, '_') << "_ " << std::endl;
         out << "| " << aliasTitle << std::string(aliasColWidth - aliasTitle.size(), ' ') << " | " << paramTitle << std::string(paramColWidth - paramTitle.size(), ' ') << " | " << helpTitle << std::string(helpColWidth - helpTitle.size(), ' ') << " |" << std::endl;
         out << "|_" << std::string(aliasColWidth, '_') << "_|_"  << std::string(paramColWidth, '_') << "_|_"  << std::string(helpColWidth, '_') << "_|" << std::endl;
-        for (const auto& [aliases, onParse, helpText] : options_) {
+        for (unsigned optionIndex : optionIndexes) {
+            std::string_view aliases = GetAliases(optionIndex);
+            std::string_view helpText = GetHelpText(optionIndex);
+            const OptionAction& onParse = options_[optionIndex].onParse_;
             out << "| " << aliases << std::string(aliasColWidth - aliases.size(), ' ') << " | " << parameterStrings.at(onParse.GetParameterRequirements()) << " | " << helpText << std::string(helpColWidth - helpText.size(), ' ') << " |"<< std::endl;
         }
 
         out << "|_" << std::string(aliasColWidth, '_') << "_|_"  << std::string(paramColWidth, '_') << "_|_"  << std::string(helpColWidth, '_') << "_|" << std::endl;
-        out << std::endl << additionalHelpText << std::endl << std::endl;
+        return out.str();
     }
+};
+
+///
+/// Key value maps
+///
+
+enum class DuplicateKey {
+    KeepFirst,
+    KeepLast,
+    Error,
+};
+
+/**
+ * @brief The FlatStringMap class is a string to string hash map for values
+ *        such as "-D name=value" defines. Every key and value is appended to a
+ *        single arena, and the entries are indexed by an open addressed table,
+ *        so an insert costs no allocations once the arena and table have
+ *        grown to fit. Clear() keeps both for reuse.
+ */
+class FlatStringMap {
+public:
+    explicit FlatStringMap(DuplicateKey duplicateKeyPolicy = DuplicateKey::KeepLast)
+        : duplicateKeyPolicy_(duplicateKeyPolicy)
+    {}
 
     /**
-     * ParseArgs parses the arguments in the order they were specified on the
-     * comand line. Once an option has been actioned, it will not be actioned
-     * again, even if a different alias for the same option was used or a
-     * different parameter value was provided.
-     *
-     * @param argc The number of string arguments, take this unmodified from
-     *             main.
-     *
-     * @param argv The string arguments to parse, take this unmodified from
-     *             main.
-     *
-     * @param parser By default assumes a Posix style "-n" for short args,
-     *               "--name" for long args and all space seperated strings
-     *               after a plain "--" are considered positional arguments. See
-     *               "SetCommandLineParser(...)" for custom behaviour.
-     *
-     * @return Any positional arguments.
+     * @return Error::DuplicateMapKey if the key is already present and the
+     *         policy is DuplicateKey::Error, the map is left unchanged.
      */
-    std::vector<std::string> ParseArgs(int argc, char** argv) const
+    Error Insert(std::string_view key, std::string_view value)
     {
-        auto [parsedArgs, positionalArgs] = argsParser_(argc, argv, errorFunc_);
-        for (const Rule& rule : rules_) {
-            rule(parsedArgs, errorFunc_);
+        if ((entries_.size() + 1) * 2 > slots_.size()) {
+            Rehash(std::max<std::size_t>(16, slots_.size() * 2));
+        }
+        std::size_t slot = FindSlot(key);
+        if (slots_[slot] != 0) {
+            Entry& entry = entries_[slots_[slot] - 1];
+            switch (duplicateKeyPolicy_) {
+            case DuplicateKey::KeepFirst :
+                return Error::None;
+            case DuplicateKey::KeepLast :
+                entry.valueOffset_ = Append(value);
+                entry.valueSize_ = static_cast<std::uint32_t>(value.size());
+                return Error::None;
+            case DuplicateKey::Error :
+                return Error::DuplicateMapKey;
+            }
+        }
+        std::uint32_t keyOffset = Append(key);
+        std::uint32_t valueOffset = Append(value);
+        entries_.push_back({ keyOffset, static_cast<std::uint32_t>(key.size()), valueOffset, static_cast<std::uint32_t>(value.size()) });
+        slots_[slot] = static_cast<std::uint32_t>(entries_.size());
+        return Error::None;
+    }
+
+    std::optional<std::string_view> Find(std::string_view key) const
+    {
+        if (slots_.empty()) {
+            return {};
+        }
+        std::uint32_t slot = slots_[FindSlot(key)];
+        if (slot == 0) {
+            return {};
+        }
+        return ValueOf(entries_[slot - 1]);
+    }
+
+    /**
+     * Calls action(key, value) for each entry, in the order the keys were
+     * first inserted. The views are invalidated by the next insert.
+     */
+    void ForEach(const std::function<void(std::string_view key, std::string_view value)>& action) const
+    {
+        for (const Entry& entry : entries_) {
+            action(KeyOf(entry), ValueOf(entry));
+        }
+    }
+
+    std::size_t Size() const
+    {
+        return entries_.size();
+    }
+
+    void Clear()
+    {
+        arena_.clear();
+        entries_.clear();
+        std::fill(slots_.begin(), slots_.end(), 0);
+    }
+
+private:
+    struct Entry {
+        std::uint32_t keyOffset_;
+        std::uint32_t keySize_;
+        std::uint32_t valueOffset_;
+        std::uint32_t valueSize_;
+    };
+
+    DuplicateKey duplicateKeyPolicy_;
+    std::string arena_;
+    std::vector<Entry> entries_;
+    // Each slot holds an index into entries_ plus one, zero if empty
+    std::vector<std::uint32_t> slots_;
+
+    std::uint32_t Append(std::string_view str)
+    {
+        auto offset = static_cast<std::uint32_t>(arena_.size());
+        arena_.append(str);
+        return offset;
+    }
+
+    std::string_view KeyOf(const Entry& entry) const
+    {
+        return std::string_view(arena_).substr(entry.keyOffset_, entry.keySize_);
+    }
+
+    std::string_view ValueOf(const Entry& entry) const
+    {
+        return std::string_view(arena_).substr(entry.valueOffset_, entry.valueSize_);
+    }
+
+    std::size_t FindSlot(std::string_view key) const
+    {
+        // slots_.size() is always a power of two
+        std::size_t mask = slots_.size() - 1;
+        std::size_t slot = std::hash<std::string_view>{}(key) & mask;
+        while (slots_[slot] != 0 && KeyOf(entries_[slots_[slot] - 1]) != key) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void Rehash(std::size_t slotCount)
+    {
+        slots_.assign(slotCount, 0);
+        for (std::uint32_t i = 0; i < entries_.size(); i++) {
+            slots_[FindSlot(KeyOf(entries_[i]))] = i + 1;
         }
-        for (const auto& [index, alias, parameter] : parsedArgs) {
-            if (aliasMap_.count(alias) > 0) {
-                unsigned aliasIndex = aliasMap_.at(alias);
-                auto optionAction = options_.at(aliasIndex).onParse_.GetAction();
-                Error actionError = optionAction(parameter);
-                if (actionError != Error::None) {
-                    errorFunc_(actionError, PointToArg(argc, argv, static_cast<int>(index)));
+    }
+};
+
+///
+/// Glob expansion
+///
+
+inline bool IsGlobPattern(std::string_view pattern)
+{
+    return pattern.find_first_of("*?[") != pattern.npos;
+}
+
+/**
+ * @brief GlobMatch matches a single path segment against a pattern segment.
+ *        '*' matches any run of characters, '?' any single character, and
+ *        "[abc]", "[a-z]" any one of the listed characters, or any character
+ *        not listed if the list begins with '!' or '^'. As in a shell, names
+ *        beginning with '.' are only matched by patterns beginning with '.'.
+ */
+inline bool GlobMatch(std::string_view pattern, std::string_view name)
+{
+    if (!name.empty() && name.front() == '.' && (pattern.empty() || pattern.front() != '.')) {
+        return false;
+    }
+
+    std::size_t p = 0;
+    std::size_t n = 0;
+    std::size_t starP = pattern.npos;
+    std::size_t starN = 0;
+    while (n < name.size()) {
+        bool matched = false;
+        std::size_t nextP = p + 1;
+        if (p < pattern.size()) {
+            if (pattern[p] == '*') {
+                starP = p++;
+                starN = n;
+                continue;
+            } else if (pattern[p] == '?') {
+                matched = true;
+            } else if (pattern[p] == '[') {
+                std::size_t first = p + 1;
+                bool negate = first < pattern.size() && (pattern[first] == '!' || pattern[first] == '^');
+                if (negate) {
+                    first++;
+                }
+                // A ']' straight after the '[' is part of the set
+                std::size_t close = pattern.find(']', first + 1);
+                if (close == pattern.npos) {
+                    matched = name[n] == '[';
+                } else {
+                    bool inSet = false;
+                    for (std::size_t i = first; i < close; i++) {
+                        if (i + 2 < close && pattern[i + 1] == '-') {
+                            inSet = inSet || (name[n] >= pattern[i] && name[n] <= pattern[i + 2]);
+                            i += 2;
+                        } else {
+                            inSet = inSet || name[n] == pattern[i];
+                        }
+                    }
+                    matched = inSet != negate;
+                    nextP = close + 1;
                 }
             } else {
-                errorFunc_(Error::UnrecognisedAlias, PointToArg(argc, argv, static_cast<int>(index)));
+                matched = pattern[p] == name[n];
+            }
+        }
+
+        if (matched) {
+            p = nextP;
+            n++;
+        } else if (starP != pattern.npos) {
+            // Backtrack, letting the last '*' consume one more character
+            p = starP + 1;
+            n = ++starN;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        p++;
+    }
+    return p == pattern.size();
+}
+
+/**
+ * @brief ExpandGlob finds every file and directory matching the pattern. Each
+ *        '/' separated segment is matched with GlobMatch, except a segment of
+ *        "**" which matches any number of nested directories, or as the last
+ *        segment every file and directory beneath. Directories are read in
+ *        parallel, symbolic links to directories are not followed by "**".
+ *        Patterns without wildcards are passed to onMatch unchanged without
+ *        touching the file system.
+ *
+ * @param onMatch Called once per match, in sorted order, after the walk.
+ *
+ * @param threadCount The number of threads used to read directories.
+ *
+ * @return Error::GlobMatchedNothing if a pattern with wildcards matched
+ *         nothing.
+ */
+inline Error ExpandGlob(const std::string& pattern, const std::function<void(const std::string&)>& onMatch, unsigned threadCount = std::thread::hardware_concurrency())
+{
+    if (!IsGlobPattern(pattern)) {
+        onMatch(pattern);
+        return Error::None;
+    }
+
+    std::string base = pattern.front() == '/' ? "/" : "";
+    std::vector<std::string> segments;
+    for (std::size_t first = 0; first < pattern.size();) {
+        std::size_t last = std::min(pattern.find('/', first), pattern.size());
+        if (last > first) {
+            segments.push_back(pattern.substr(first, last - first));
+        }
+        first = last + 1;
+    }
+    auto join = [](const std::string& dir, const std::string& name)
+    {
+        return dir.empty() ? name : (dir.back() == '/' ? dir + name : dir + "/" + name);
+    };
+    std::size_t firstWildcard = 0;
+    while (!IsGlobPattern(segments[firstWildcard])) {
+        base = join(base, segments[firstWildcard++]);
+    }
+
+    struct Task {
+        std::string dir_;
+        std::size_t segment_;
+    };
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Task> tasks{ { base, firstWildcard } };
+    unsigned busy = 0;
+    std::vector<std::string> matches;
+
+    auto process = [&](const Task& task, std::vector<Task>& newTasks, std::vector<std::string>& newMatches)
+    {
+        namespace fs = std::filesystem;
+        const std::string& segment = segments[task.segment_];
+        const bool last = task.segment_ + 1 == segments.size();
+        std::error_code error;
+
+        if (!IsGlobPattern(segment)) {
+            std::string path = join(task.dir_, segment);
+            if (last ? fs::exists(path, error) : fs::is_directory(path, error)) {
+                if (last) {
+                    newMatches.push_back(path);
+                } else {
+                    newTasks.push_back({ path, task.segment_ + 1 });
+                }
+            }
+            return;
+        }
+
+        const bool recursive = segment == "**";
+        if (recursive && !last) {
+            newTasks.push_back({ task.dir_, task.segment_ + 1 });
+        }
+        for (fs::directory_iterator iter(task.dir_.empty() ? "." : task.dir_, error), end; !error && iter != end; iter.increment(error)) {
+            std::string name = iter->path().filename().string();
+            std::string path = join(task.dir_, name);
+            if (recursive) {
+                if (name.front() == '.') {
+                    continue;
+                }
+                if (last) {
+                    newMatches.push_back(path);
+                }
+                std::error_code statusError;
+                if (iter->is_directory(statusError) && !iter->is_symlink(statusError)) {
+                    newTasks.push_back({ path, task.segment_ });
+                }
+            } else if (GlobMatch(segment, name)) {
+                std::error_code statusError;
+                if (last) {
+                    newMatches.push_back(path);
+                } else if (iter->is_directory(statusError)) {
+                    newTasks.push_back({ path, task.segment_ + 1 });
+                }
+            }
+        }
+    };
+
+    auto worker = [&]()
+    {
+        std::vector<Task> newTasks;
+        std::vector<std::string> newMatches;
+        std::unique_lock lock(mutex);
+        while (true) {
+            wake.wait(lock, [&](){ return !tasks.empty() || busy == 0; });
+            if (tasks.empty()) {
+                return;
             }
+            Task task = std::move(tasks.front());
+            tasks.pop_front();
+            busy++;
+            lock.unlock();
+
+            newTasks.clear();
+            newMatches.clear();
+            process(task, newTasks, newMatches);
+
+            lock.lock();
+            busy--;
+            std::move(newTasks.begin(), newTasks.end(), std::back_inserter(tasks));
+            std::move(newMatches.begin(), newMatches.end(), std::back_inserter(matches));
+            wake.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < std::max(threadCount, 1u); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // "**" can reach the same path more than once, e.g. "a/**/**/b"
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    for (const auto& match : matches) {
+        onMatch(match);
+    }
+    return matches.empty() ? Error::GlobMatchedNothing : Error::None;
+}
+
+inline Error ExpandGlob(const std::string& pattern, std::vector<std::string>& pathsOut, unsigned threadCount = std::thread::hardware_concurrency())
+{
+    return ExpandGlob(pattern, [&](const std::string& path){ pathsOut.push_back(path); }, threadCount);
+}
+
+/**
+ * Expands each pattern in turn, e.g. the positional args returned by
+ * ArgParser::ParseArgs(...). Stops at the first pattern that matches nothing.
+ */
+inline Error ExpandGlobs(const std::vector<std::string>& patterns, std::vector<std::string>& pathsOut, unsigned threadCount = std::thread::hardware_concurrency())
+{
+    for (const auto& pattern : patterns) {
+        if (Error error = ExpandGlob(pattern, pathsOut, threadCount); error != Error::None) {
+            return error;
         }
-        return positionalArgs;
     }
-
-private:
-    const ErrorHandler errorFunc_;
-    const ArgsParser argsParser_;
-
-    std::vector<Option> options_;
-    //      <   alias   ,  index  >
-    std::map<std::string, unsigned> aliasMap_;
-    std::vector<Rule> rules_;
-};
+    return Error::None;
+}
 
 ///
 /// OptionAction Helpers
@@ -644,7 +3430,7 @@ private:
 template <typename T>
 inline OptionActionRequiredParam SetValue(T& valueOut, ParameterParser<T>& parser = GetDefaultParser<T>())
 {
-    return [&](const std::string& argValue) -> Error
+    return [&valueOut, parser](const std::string& argValue) -> Error
     {
         return parser(argValue, valueOut);
     };
@@ -653,7 +3439,7 @@ inline OptionActionRequiredParam SetValue(T& valueOut, ParameterParser<T>& parse
 template <typename T>
 inline OptionActionOptionalParam SetValue(T& valueOut, const T& defaultValue, ParameterParser<T>& parser = GetDefaultParser<T>())
 {
-    return [&](const std::optional<std::string>& param) -> Error
+    return [&valueOut, defaultValue, parser](const std::optional<std::string>& param) -> Error
     {
         if (!param) {
             valueOut = defaultValue;
@@ -664,10 +3450,132 @@ inline OptionActionOptionalParam SetValue(T& valueOut, const T& defaultValue, Pa
     };
 }
 
+/**
+ * Splits a parameter holding multiple values, see OptionAction::WithArity.
+ */
+inline std::vector<std::string_view> SplitValues(std::string_view parameter)
+{
+    std::vector<std::string_view> values;
+    ForEachValue(parameter, [&](std::string_view value){ values.push_back(value); });
+    return values;
+}
+
+/**
+ * Sets each element of the array to one of exactly N values, e.g.
+ * "--point 1 2 3". The array is only modified if every value parses.
+ */
+template <typename T, std::size_t N>
+inline OptionAction SetValues(std::array<T, N>& valuesOut, ParameterParser<T>& parser = GetDefaultParser<T>())
+{
+    return OptionAction(OptionActionRequiredParam([&valuesOut, parser](const std::string& param) -> Error
+    {
+        std::vector<std::string_view> views = SplitValues(param);
+        if (views.size() != N) {
+            return Error::WrongParameterCount;
+        }
+        std::array<T, N> values;
+        std::string value;
+        for (std::size_t i = 0; i < N; i++) {
+            value.assign(views[i]);
+            if (Error error = parser(value, values[i]); error != Error::None) {
+                return error;
+            }
+        }
+        valuesOut = std::move(values);
+        return Error::None;
+    })).WithArity(N, N);
+}
+
+/**
+ * Sets each element of the tuple to one of exactly sizeof...(T) values, each
+ * parsed by its type's default parser, e.g. "--range 10 20.5". The tuple is
+ * only modified if every value parses.
+ */
+template <typename... T>
+inline OptionAction SetValues(std::tuple<T...>& valuesOut)
+{
+    return OptionAction(OptionActionRequiredParam([&valuesOut](const std::string& param) -> Error
+    {
+        std::vector<std::string_view> views = SplitValues(param);
+        if (views.size() != sizeof...(T)) {
+            return Error::WrongParameterCount;
+        }
+        std::tuple<T...> values;
+        Error error = Error::None;
+        std::size_t index = 0;
+        auto parseNext = [&](auto& value)
+        {
+            if (error == Error::None) {
+                error = GetDefaultParser<std::decay_t<decltype(value)>>()(std::string(views[index++]), value);
+            }
+        };
+        std::apply([&](auto&... value){ (parseNext(value), ...); }, values);
+        if (error == Error::None) {
+            valuesOut = std::move(values);
+        }
+        return error;
+    })).WithArity(sizeof...(T), sizeof...(T));
+}
+
+/**
+ * Replaces the contents of the vector with between minValues and maxValues
+ * values, e.g. "--files a b c". The vector is reserved to the number of
+ * values before they are parsed, and is only modified if every value parses.
+ * If minValues is 0 the parameter is Parameter::Optional, and the alias alone
+ * clears the vector.
+ */
+template <typename T>
+inline OptionAction SetValues(std::vector<T>& valuesOut, unsigned minValues = 1, unsigned maxValues = std::numeric_limits<unsigned>::max(), ParameterParser<T>& parser = GetDefaultParser<T>())
+{
+    auto setValues = [&valuesOut, parser](const std::string& param) -> Error
+    {
+        std::vector<T> values;
+        values.reserve(static_cast<std::size_t>(std::count(param.cbegin(), param.cend(), '\0') + 1));
+        Error error = Error::None;
+        std::string value;
+        ForEachValue(param, [&](std::string_view view)
+        {
+            if (error == Error::None) {
+                value.assign(view);
+                error = parser(value, values.emplace_back());
+            }
+        });
+        if (error == Error::None) {
+            valuesOut = std::move(values);
+        }
+        return error;
+    };
+    if (minValues == 0) {
+        return OptionAction(OptionActionOptionalParam([&valuesOut, setValues](const std::optional<std::string>& param) -> Error
+        {
+            if (!param) {
+                valuesOut.clear();
+                return Error::None;
+            }
+            return setValues(param.value());
+        })).WithArity(minValues, maxValues);
+    }
+    return OptionAction(OptionActionRequiredParam(std::move(setValues))).WithArity(minValues, maxValues);
+}
+
+/**
+ * Moves the parameter into valueOut, so large parameters are never copied
+ * between the args and the destination. The parameter is no longer available
+ * to DumpConfiguration(...) or InternedParseResult after the parse.
+ */
+inline OptionAction MoveValue(std::string& valueOut)
+{
+    return OptionAction::TakingOwnership([&valueOut](std::string&& argValue) -> Error
+    {
+        valueOut = std::move(argValue);
+        return Error::None;
+    });
+}
+
 template <typename T>
 inline OptionActionOptionalParam SetOptionalValue(std::optional<T>& valueOut, ParameterParser<T>& parser = GetDefaultParser<T>())
 {
-    return [&](const std::optional<std::string> param) -> Error
+    return [&valueOut, parser](const std::optional<std::string> param) -> Error
     {
         if (!param) {
             valueOut = {};
@@ -683,6 +3591,35 @@ inline OptionActionOptionalParam SetOptionalValue(std::optional<T>& valueOut, Pa
     };
 }
 
+/**
+ * Appends every path matching the parameter, which may be a glob pattern, see
+ * ExpandGlob(...).
+ */
+inline OptionActionRequiredParam SetPaths(std::vector<std::string>& pathsOut)
+{
+    return [&](const std::string& pattern) -> Error
+    {
+        return ExpandGlob(pattern, pathsOut);
+    };
+}
+
+/**
+ * Splits the parameter at the first '=' and inserts the key and value into
+ * the map, e.g. "-D name=value". The key must not be empty.
+ */
+inline OptionActionRequiredParam SetMap(FlatStringMap& mapOut)
+{
+    return [&](const std::string& keyValue) -> Error
+    {
+        auto equals = keyValue.find('=');
+        if (equals == keyValue.npos || equals == 0) {
+            return Error::ParameterParseError;
+        }
+        std::string_view view = keyValue;
+        return mapOut.Insert(view.substr(0, equals), view.substr(equals + 1));
+    };
+}
+
 inline OptionActionNoParam DetectPresence(bool& valueOut)
 {
     return [&]() -> Error
@@ -704,6 +3641,372 @@ inline OptionActionNoParam PrintHelp(const ArgParser& parser, bool exitAfter = t
     };
 }
 
+/**
+ * Prints the help table, or if given a parameter, only the Options in that
+ * namespace of dotted aliases, e.g. "--help=db.pool", see
+ * ArgParser::PrintHelpTableFor(...). A namespace with no Options is reported
+ * as Error::UnrecognisedAlias.
+ */
+inline OptionActionOptionalParam PrintHelpFor(const ArgParser& parser, bool exitAfter = true, std::ostream& ostr = std::cout)
+{
+    return [&parser, exitAfter, &ostr](const std::optional<std::string>& subtree) -> Error
+    {
+        if (!subtree) {
+            parser.PrintHelpTable(ostr);
+        } else if (!parser.PrintHelpTableFor(subtree.value(), ostr)) {
+            return Error::UnrecognisedAlias;
+        }
+        if (exitAfter) {
+            exit(0);
+        }
+        return Error::None;
+    };
+}
+
+///
+/// Scoped Options
+///
+
+/**
+ * @brief The ScopedOptions class collects Options that apply to the most
+ *        recently opened scope, e.g. "--input a.csv --format csv --input b.json
+ *        --format json" opens a scope per "--input" and each "--format" is
+ *        applied to the input before it. A T is created for each scope as a
+ *        copy of the defaults, all in the same single pass over the args as
+ *        every other Option. The actions refer to this object, so it must not
+ *        be moved and must outlive the Options using them.
+ */
+template <typename T>
+class ScopedOptions {
+public:
+    struct Scope {
+        int argIndex_;
+        T values_;
+    };
+
+    explicit ScopedOptions(T defaults = {})
+        : defaults_(std::move(defaults))
+    {}
+
+    /**
+     * Opens a new scope, and sets the member of that scope to the parameter.
+     */
+    template <typename M>
+    OptionAction OpenScope(M T::* member, ParameterParser<M>& parser = GetDefaultParser<M>())
+    {
+        return OptionAction::ReceivingArgIndex([this, member, parser](const std::string& param, int argIndex) -> Error
+        {
+            M value;
+            Error error = parser(param, value);
+            if (error == Error::None) {
+                scopes_.push_back({ argIndex, defaults_ });
+                scopes_.back().values_.*member = std::move(value);
+            }
+            return error;
+        });
+    }
+
+    /**
+     * Sets the member of the most recently opened scope to the parameter.
+     */
+    template <typename M>
+    OptionActionRequiredParam SetValue(M T::* member, ParameterParser<M>& parser = GetDefaultParser<M>())
+    {
+        return [this, member, parser](const std::string& param) -> Error
+        {
+            if (scopes_.empty()) {
+                return Error::NoOpenScope;
+            }
+            return parser(param, scopes_.back().values_.*member);
+        };
+    }
+
+    /**
+     * Sets the member of the most recently opened scope to true.
+     */
+    OptionActionNoParam DetectPresence(bool T::* member)
+    {
+        return [this, member]() -> Error
+        {
+            if (scopes_.empty()) {
+                return Error::NoOpenScope;
+            }
+            scopes_.back().values_.*member = true;
+            return Error::None;
+        };
+    }
+
+    const std::vector<Scope>& GetScopes() const
+    {
+        return scopes_;
+    }
+
+    void Clear()
+    {
+        scopes_.clear();
+    }
+
+private:
+    const T defaults_;
+    std::vector<Scope> scopes_;
+};
+
+///
+/// Configuration Snapshots
+///
+
+/**
+ * @brief The ConfigSnapshots class publishes each successful parse as a new
+ *        immutable T, so readers on other threads never see a configuration
+ *        while it is being reloaded. Options set members of a draft T, which
+ *        ParseArgs(...) starts as a copy of the current snapshot and publishes
+ *        if the parse reported no errors.
+ *
+ *        Publishing is read-copy-update. Read() is wait-free, it counts the
+ *        reader in one of a few cache line sized slots, in one of two counters
+ *        chosen by the current epoch, and loads the current snapshot. Publish()
+ *        swaps in the new snapshot, then waits for a grace period, advancing
+ *        the epoch twice and waiting for each counter it leaves behind to
+ *        drain, before deleting the old snapshot. Any reader that could have
+ *        loaded the old snapshot has then finished with it.
+ *
+ *        The actions refer to this object, so it must not be moved and must
+ *        outlive the Options using them. Snapshots must be released before
+ *        this object is destroyed.
+ */
+template <typename T>
+class ConfigSnapshots {
+private:
+    static constexpr std::size_t slotCount = 16;
+
+    struct alignas(64) ReaderSlot {
+        std::array<std::atomic<unsigned>, 2> readers_ = {};
+    };
+
+public:
+    /**
+     * A read lock on a snapshot, the snapshot won't be deleted until every
+     * Snapshot referring to it has been destroyed. Keep them short lived, as
+     * Publish() waits for them.
+     */
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other)
+            : value_(other.value_)
+            , readers_(std::exchange(other.readers_, nullptr))
+        {}
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        Snapshot& operator=(Snapshot&&) = delete;
+
+        ~Snapshot()
+        {
+            if (readers_) {
+                readers_->fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        const T& operator*() const
+        {
+            return *value_;
+        }
+
+        const T* operator->() const
+        {
+            return value_;
+        }
+
+    private:
+        friend class ConfigSnapshots;
+
+        Snapshot(const T* value, std::atomic<unsigned>* readers)
+            : value_(value)
+            , readers_(readers)
+        {}
+
+        const T* value_;
+        std::atomic<unsigned>* readers_;
+    };
+
+    explicit ConfigSnapshots(T initial = {})
+        : current_(new T(initial))
+        , draft_(std::move(initial))
+    {}
+
+    ConfigSnapshots(const ConfigSnapshots&) = delete;
+    ConfigSnapshots& operator=(const ConfigSnapshots&) = delete;
+
+    ~ConfigSnapshots()
+    {
+        delete current_.load();
+    }
+
+    /**
+     * Returns the current snapshot. Wait-free, and safe to call from any
+     * number of threads while another publishes.
+     */
+    Snapshot Read() const
+    {
+        static thread_local const std::size_t slot = std::hash<std::thread::id>{}(std::this_thread::get_id()) % slotCount;
+        std::atomic<unsigned>& readers = slots_[slot].readers_[epoch_.load(std::memory_order_acquire) & 1];
+        readers.fetch_add(1, std::memory_order_seq_cst);
+        return Snapshot(current_.load(std::memory_order_seq_cst), &readers);
+    }
+
+    /**
+     * Sets the member of the draft to the parameter.
+     */
+    template <typename M>
+    OptionActionRequiredParam SetValue(M T::* member, ParameterParser<M>& parser = GetDefaultParser<M>())
+    {
+        return [this, member, parser](const std::string& param) -> Error
+        {
+            return parser(param, draft_.*member);
+        };
+    }
+
+    /**
+     * Sets the member of the draft to true.
+     */
+    OptionActionNoParam DetectPresence(bool T::* member)
+    {
+        return [this, member]() -> Error
+        {
+            draft_.*member = true;
+            return Error::None;
+        };
+    }
+
+    /**
+     * Resets the draft to a copy of the current snapshot, parses the args into
+     * it and, if the parser reported no errors, publishes it. Only one thread
+     * may parse or publish at a time.
+     *
+     * @return Any positional arguments.
+     */
+    std::vector<std::string> ParseArgs(const ArgParser& parser, int argc, char** argv)
+    {
+        {
+            Snapshot current = Read();
+            draft_ = *current;
+        }
+        ParseResult result;
+        std::vector<std::string> positionalArgs = parser.ParseArgs(argc, argv, result);
+        if (result.errorCount_ == 0) {
+            Publish();
+        }
+        return positionalArgs;
+    }
+
+    /**
+     * Publishes a copy of the draft, returning once the previous snapshot has
+     * been deleted.
+     */
+    void Publish()
+    {
+        std::lock_guard lock(publishMutex_);
+        const T* previous = current_.exchange(new T(draft_), std::memory_order_seq_cst);
+        for (int phase = 0; phase < 2; phase++) {
+            const unsigned parity = epoch_.fetch_add(1, std::memory_order_seq_cst) & 1;
+            for (const ReaderSlot& slot : slots_) {
+                while (slot.readers_[parity].load(std::memory_order_acquire) != 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        delete previous;
+        publishCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns how many snapshots have been published, not counting the
+     * initial one.
+     */
+    unsigned GetPublishCount() const
+    {
+        return publishCount_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<const T*> current_;
+    std::atomic<unsigned> epoch_ = 0;
+    std::atomic<unsigned> publishCount_ = 0;
+    mutable std::array<ReaderSlot, slotCount> slots_;
+    std::mutex publishMutex_;
+    T draft_;
+};
+
+///
+/// Option Namespaces
+///
+
+/**
+ * @brief The FieldBinding class creates the Options for one member of an S,
+ *        named by its dotted path, see Field(...) and BindFields(...).
+ */
+template <typename S>
+class FieldBinding {
+public:
+    using Binder = std::function<void(S& object, const std::string& prefix, std::vector<Option>& optionsOut)>;
+
+    explicit FieldBinding(Binder binder)
+        : binder_(std::move(binder))
+    {}
+
+    void Bind(S& object, const std::string& prefix, std::vector<Option>& optionsOut) const
+    {
+        binder_(object, prefix, optionsOut);
+    }
+
+private:
+    Binder binder_;
+};
+
+/**
+ * A member set by an Option with the alias "prefix.name", as SetValue(...).
+ */
+template <typename S, typename M>
+inline FieldBinding<S> Field(std::string name, M S::* member, std::string helpText = "")
+{
+    return FieldBinding<S>([name = std::move(name), member, helpText = std::move(helpText)](S& object, const std::string& prefix, std::vector<Option>& optionsOut)
+    {
+        optionsOut.push_back({ prefix + name, SetValue(object.*member), helpText });
+    });
+}
+
+/**
+ * A nested struct member, whose own fields are bound below "prefix.name.".
+ */
+template <typename S, typename M>
+inline FieldBinding<S> Field(std::string name, M S::* member, std::vector<FieldBinding<M>> fields)
+{
+    return FieldBinding<S>([name = std::move(name), member, fields = std::move(fields)](S& object, const std::string& prefix, std::vector<Option>& optionsOut)
+    {
+        const std::string nestedPrefix = prefix + name + ".";
+        for (const FieldBinding<M>& field : fields) {
+            field.Bind(object.*member, nestedPrefix, optionsOut);
+        }
+    });
+}
+
+/**
+ * Creates an Option per leaf field, bound to the members of object, with the
+ * dotted path from prefix as its alias, e.g. BindFields("db", config.db, {
+ * Field("host", &Db::host), Field("pool", &Db::pool, { Field("size",
+ * &Pool::size) }) }) creates "db.host" and "db.pool.size". The object must
+ * outlive the Options.
+ */
+template <typename S>
+inline std::vector<Option> BindFields(const std::string& prefix, S& object, const std::vector<FieldBinding<S>>& fields)
+{
+    std::vector<Option> options;
+    const std::string fullPrefix = prefix.empty() ? prefix : prefix + ".";
+    for (const FieldBinding<S>& field : fields) {
+        field.Bind(object, fullPrefix, options);
+    }
+    return options;
+}
+
 ///
 /// ArgsRule Helpers
 ///
@@ -747,6 +4050,38 @@ inline Rule RuleRequireAllOrNone(const std::vector<std::string>& ruleAliases)
     };
 }
 
+///
+/// Constraint Helpers
+///
+
+/**
+ * Requires compare(lhs, rhs), by default lhs <= rhs, e.g. "--min <= --max".
+ * The values are read when the Constraint is checked, so should be the
+ * variables the Options set.
+ */
+template <typename T, typename Compare = std::less_equal<T>>
+inline Constraint ConstrainOrder(const std::string& lhsAlias, const T& lhs, const std::string& rhsAlias, const T& rhs, Compare compare = {})
+{
+    return { { lhsAlias, rhsAlias }, [&lhs, &rhs, compare]() -> bool
+    {
+        return compare(lhs, rhs);
+    } };
+}
+
+/**
+ * Requires check(values...) for the values of the Options with the given
+ * aliases, in the same order, e.g. ConstrainValues({ "w", "h" }, [](int w,
+ * int h){ return w * h <= 4096; }, width, height).
+ */
+template <typename Check, typename... T>
+inline Constraint ConstrainValues(std::vector<std::string> aliases, Check check, const T&... values)
+{
+    return { std::move(aliases), [check, &values...]() -> bool
+    {
+        return check(values...);
+    } };
+}
+
 } // namespace EzArgs
 
 #endif // EZARGS_H
@@ -5,6 +5,10 @@
 #include <sstream>
 #include <optional>
 #include <vector>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <future>
 
 // Let Catch print our types
 namespace Catch {
@@ -772,6 +776,1724 @@ TEST_CASE("Parse Errors","[parse]")
 
 }
 
+TEST_CASE("Memory footprint", "[memory]")
+{
+    auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--threads=8", "-v", "--output", "a/reasonably/long/output/path/name.txt" });
+    ArgParser parser(std::move(errFunc));
+
+    SECTION("Empty parser")
+    {
+        MemoryFootprint footprint = parser.GetMemoryFootprint();
+        REQUIRE(footprint.options_ == 0);
+        REQUIRE(footprint.validators_ == 0);
+        REQUIRE(footprint.aliasIndex_ == 0);
+        REQUIRE(footprint.aliasTrie_ == 0);
+        REQUIRE(footprint.rules_ == 0);
+        REQUIRE(footprint.constraints_ == 0);
+        REQUIRE(footprint.resolver_ == 0);
+        REQUIRE(footprint.environment_ == 0);
+        REQUIRE(footprint.Total() == 0);
+    }
+
+    SECTION("Representative schema")
+    {
+        unsigned threads = 0;
+        bool verbose = false;
+        std::string output;
+        unsigned retries = 0;
+        const char* environment[] = { "HOME=/home/user", "LANG=C", nullptr };
+        parser.SetOptions({
+                              {"t,threads", SetValue(threads), "Number of worker threads", { ValidatePattern("[1-9][0-9]*") }},
+                              {"v,verbose", DetectPresence(verbose), "Print progress"},
+                              {"o,output", SetValue(output), "Where the results are written"},
+                              {"net.retries", SetValue(retries), "Connection retries"},
+                          });
+        parser.SetRules({ RuleRequireAtLeastOne({ "output" }) });
+        parser.SetConstraints({ ConstrainOrder("net.retries", retries, "threads", threads) });
+        parser.SetAliasResolver([](const std::string&){ return std::vector<Option>(); });
+        parser.SetEnvironmentExpansion(std::make_shared<EnvironmentSnapshot>(environment));
+        REQUIRE(errors.empty());
+
+        // Every structure the parser owns is counted
+        MemoryFootprint footprint = parser.GetMemoryFootprint();
+        REQUIRE(footprint.options_ >= 4 * sizeof(Option));
+        REQUIRE(footprint.validators_ >= 4 * sizeof(std::vector<CompiledValidator>) + sizeof(CompiledValidator));
+        REQUIRE(footprint.aliasIndex_ >= 6 * sizeof(std::pair<const std::string, unsigned>));
+        REQUIRE(footprint.aliasTrie_ > 0);
+        REQUIRE(footprint.rules_ == sizeof(Rule));
+        REQUIRE(footprint.constraints_ >= sizeof(Constraint) + 2 * sizeof(std::string));
+        REQUIRE(footprint.resolver_ > 0);
+        REQUIRE(footprint.environment_ >= sizeof(EnvironmentSnapshot) + 22);
+        REQUIRE(footprint.Total() == footprint.options_ + footprint.validators_ + footprint.aliasIndex_ + footprint.aliasTrie_ + footprint.rules_ + footprint.constraints_ + footprint.resolver_ + footprint.environment_);
+
+        // Budget, catches regressions in the per Option cost of the tables
+        REQUIRE(footprint.options_ + footprint.aliasIndex_ <= 4 * 512);
+
+        std::vector<Constraint> constraints(1000, ConstrainOrder("threads", threads, "net.retries", retries));
+        parser.SetConstraints(std::move(constraints));
+        REQUIRE(parser.GetMemoryFootprint().constraints_ >= 1000 * sizeof(Constraint));
+        parser.SetConstraints({ ConstrainOrder("net.retries", retries, "threads", threads) });
+        footprint = parser.GetMemoryFootprint();
+
+        // Nothing is retained by printing help or parsing
+        std::stringstream help;
+        parser.PrintHelpTable(help);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(output == "a/reasonably/long/output/path/name.txt");
+        REQUIRE(parser.GetMemoryFootprint().Total() == footprint.Total());
+
+        parser.SetOptions({});
+        footprint = parser.GetMemoryFootprint();
+        REQUIRE(footprint.aliasIndex_ == 0);
+    }
+
+    SECTION("Large schema scales linearly")
+    {
+        std::vector<bool> flags(200, false);
+        auto makeOptions = [&](unsigned count)
+        {
+            std::vector<Option> options;
+            for (unsigned i = 0; i < count; i++) {
+                options.push_back({ "flag-number-" + std::to_string(i), OptionActionNoParam([&, i]() -> Error { flags[i] = true; return Error::None; }), "Sets flag " + std::to_string(i) });
+            }
+            return options;
+        };
+
+        parser.SetOptions(makeOptions(100));
+        MemoryFootprint hundred = parser.GetMemoryFootprint();
+        parser.SetOptions(makeOptions(200));
+        MemoryFootprint twoHundred = parser.GetMemoryFootprint();
+        REQUIRE(errors.empty());
+
+        REQUIRE(twoHundred.aliasIndex_ == 2 * hundred.aliasIndex_);
+        REQUIRE(twoHundred.options_ <= 200 * 256);
+        REQUIRE(twoHundred.aliasIndex_ <= 200 * 256);
+    }
+}
+
+TEST_CASE("Compiled schema", "[schema]")
+{
+    auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--threads=8", "-v", "--name", "worker" });
+
+    unsigned threads = 0;
+    bool verbose = false;
+    std::string name;
+
+    std::vector<char> blob;
+    {
+        ArgParser builder([](Error, auto){});
+        builder.SetOptions({
+                               {"t,threads", SetValue(threads), "Number of worker threads", { ValidateRange(1, 8) }},
+                               {"v,verbose", DetectPresence(verbose), "Print progress"},
+                               {"n,name", SetValue(name), "Worker name", { ValidateLength(1, 16), ValidatePattern("[a-z][a-z0-9-]*") }},
+                           });
+        blob = builder.CompileSchema();
+    }
+
+    SECTION("Schema contents")
+    {
+        CompiledSchema schema(blob.data(), blob.size());
+        REQUIRE(schema.IsValid());
+        REQUIRE(schema.OptionCount() == 3);
+        REQUIRE(schema.AliasCount() == 6);
+        REQUIRE(schema.GetAliases(0) == "t,threads");
+        REQUIRE(schema.GetHelpText(2) == "Worker name");
+        REQUIRE(schema.GetParameterRequirements(0) == Parameter::Required);
+        REQUIRE(schema.GetParameterRequirements(1) == Parameter::None);
+        REQUIRE(schema.Find("threads") == 0u);
+        REQUIRE(schema.Find("v") == 1u);
+        REQUIRE(schema.Find("name") == 2u);
+        REQUIRE(!schema.Find("nam"));
+        REQUIRE(!schema.Find(""));
+        REQUIRE(schema.ValidatorCount() == 3);
+        REQUIRE(schema.GetValidators(1).empty());
+        std::vector<Validator> validators = schema.GetValidators(2);
+        REQUIRE(validators.size() == 2);
+        REQUIRE(validators[0].kind_ == Validator::Kind::Length);
+        REQUIRE(validators[0].max_ == 16.0);
+        REQUIRE(validators[1].kind_ == Validator::Kind::Pattern);
+        REQUIRE(validators[1].pattern_ == "[a-z][a-z0-9-]*");
+    }
+
+    SECTION("Position independent")
+    {
+        std::vector<char> moved(blob.size() + 3);
+        std::copy(blob.cbegin(), blob.cend(), moved.begin() + 3);
+        CompiledSchema schema(moved.data() + 3, blob.size());
+        REQUIRE(schema.IsValid());
+        REQUIRE(schema.Find("verbose") == 1u);
+    }
+
+    SECTION("Invalid blobs")
+    {
+        REQUIRE(!CompiledSchema(nullptr, 0).IsValid());
+        REQUIRE(!CompiledSchema(blob.data(), blob.size() - 1).IsValid());
+        std::vector<char> corrupt = blob;
+        corrupt[0] = 'X';
+        REQUIRE(!CompiledSchema(corrupt.data(), corrupt.size()).IsValid());
+    }
+
+    SECTION("Parse with bound actions")
+    {
+        ArgParser parser(std::move(errFunc));
+        parser.SetOptions(CompiledSchema(blob.data(), blob.size()), { SetValue(threads), DetectPresence(verbose), SetValue(name) });
+        REQUIRE(errors.empty());
+
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(threads == 8);
+        REQUIRE(verbose);
+        REQUIRE(name == "worker");
+
+        std::stringstream help;
+        parser.PrintHelpTable(help);
+        REQUIRE(help.str().find("t,threads") != std::string::npos);
+        REQUIRE(help.str().find("Worker name") != std::string::npos);
+
+        REQUIRE(parser.CompileSchema() == blob);
+    }
+
+    SECTION("Validators survive the round trip")
+    {
+        std::vector<Error> parseErrors;
+        ArgParser parser([&](Error error, const std::string&){ parseErrors.push_back(error); });
+        parser.SetOptions(CompiledSchema(blob.data(), blob.size()), { SetValue(threads), DetectPresence(verbose), SetValue(name) });
+        REQUIRE(parseErrors.empty());
+
+        ArgvBuffer args{ "./app/path/test.exe", "--threads", "500", "--name", "Worker" };
+        threads = 0;
+        name.clear();
+        parser.ParseArgs(args.Argc(), args.Argv());
+        REQUIRE(parseErrors == std::vector<Error>{ Error::ValidationFailed, Error::ValidationFailed });
+        REQUIRE(threads == 0);
+        REQUIRE(name.empty());
+    }
+
+    SECTION("Mismatched actions")
+    {
+        ArgParser parser(std::move(errFunc));
+        parser.SetOptions(CompiledSchema(blob.data(), blob.size()), { SetValue(threads), DetectPresence(verbose) });
+        CHECK(errors.size() == 1);
+        REQUIRE(errors.front() == Error::InvalidCompiledSchema);
+
+        errors.clear();
+        parser.SetOptions(CompiledSchema(blob.data(), blob.size()), { SetValue(threads), SetValue(name), SetValue(name) });
+        CHECK(errors.size() == 1);
+        REQUIRE(errors.front() == Error::InvalidCompiledSchema);
+    }
+}
+
+TEST_CASE("Interned parse results", "[interned]")
+{
+    SECTION("StringPool")
+    {
+        StringPool pool;
+        std::string_view first = pool.Intern("hello");
+        std::string_view second = pool.Intern(std::string("hel") + "lo");
+        REQUIRE(first.data() == second.data());
+        REQUIRE(first == "hello");
+        REQUIRE(first.data()[first.size()] == '\0');
+        REQUIRE(pool.Intern("").data() != nullptr);
+        REQUIRE(pool.Intern("").data() == pool.Intern("").data());
+        REQUIRE(pool.Intern("world").data() != first.data());
+        REQUIRE(pool.Count() == 3);
+
+        std::string large(10000, 'x');
+        std::string_view largeInterned = pool.Intern(large);
+        REQUIRE(largeInterned == large);
+        REQUIRE(pool.Intern(large).data() == largeInterned.data());
+        REQUIRE(pool.Count() == 4);
+
+        // Small strings still fill the current block after a large one
+        std::string_view afterLarge = pool.Intern("after");
+        REQUIRE(afterLarge == "after");
+
+        std::string_view embedded = pool.Intern(std::string_view("1\0" "2\0" "3", 5));
+        REQUIRE(embedded.size() == 5);
+        REQUIRE(pool.Intern(std::string_view("1\0" "2", 3)).data() != embedded.data());
+    }
+
+    SECTION("StringPool shared between threads")
+    {
+        StringPool pool;
+        std::vector<std::vector<const char*>> interned(4);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < interned.size(); t++) {
+            threads.emplace_back([&, t]()
+            {
+                for (unsigned i = 0; i < 1000; i++) {
+                    interned[t].push_back(pool.Intern("value-" + std::to_string(i)).data());
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(pool.Count() == 1000);
+        for (unsigned t = 1; t < interned.size(); t++) {
+            REQUIRE(interned[t] == interned.front());
+        }
+    }
+
+    SECTION("Parse")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--mode=fast", "-v", "-m", "fast", "--point", "1", "2", "3", "--", "input.txt" });
+        ArgParser parser(std::move(errFunc));
+        std::string mode;
+        bool verbose = false;
+        std::array<int, 3> point = { 0, 0, 0 };
+        parser.SetOptions({
+                              {"m,mode", SetValue(mode), ""},
+                              {"v,verbose", DetectPresence(verbose), ""},
+                              {"p,point", SetValues(point), ""},
+                          });
+
+        StringPool pool;
+        InternedParseResult result = parser.ParseArgs(argc, argv, pool);
+        REQUIRE(errors.empty());
+        REQUIRE(mode == "fast");
+        REQUIRE(verbose);
+
+        CHECK(result.args_.size() == 4);
+        REQUIRE(result.args_[0].index_ == 1);
+        REQUIRE(result.args_[0].option_ == 0);
+        REQUIRE(result.args_[0].GetParameter() == "fast");
+        REQUIRE(result.args_[1].option_ == 1);
+        REQUIRE(!result.args_[1].GetParameter());
+        REQUIRE(result.args_[2].index_ == 3);
+        REQUIRE(result.args_[2].parameter_.data() == result.args_[0].parameter_.data());
+        REQUIRE(SplitValues(result.args_[3].parameter_) == std::vector<std::string_view>{ "1", "2", "3" });
+        CHECK(result.positionalArgs_.size() == 1);
+        REQUIRE(result.positionalArgs_.front() == "input.txt");
+        REQUIRE(sizeof(InternedArg) < sizeof(ParsedArg));
+    }
+}
+
+TEST_CASE("Environment expansion", "[environment]")
+{
+    const char* environment[] = { "HOME=/home/user", "EMPTY=", "XDG_CACHE_HOME=/tmp/cache", "=ignored", "malformed", nullptr };
+    EnvironmentSnapshot snapshot(environment);
+
+    SECTION("Snapshot")
+    {
+        REQUIRE(snapshot.Find("HOME") == "/home/user");
+        REQUIRE(snapshot.Find("EMPTY") == "");
+        REQUIRE(!snapshot.Find("malformed"));
+        REQUIRE(!snapshot.Find(""));
+        REQUIRE(!snapshot.Find("UNSET"));
+        REQUIRE(!EnvironmentSnapshot::FromEnviron().Find("EZARGS_SURELY_UNSET_VARIABLE"));
+    }
+
+    SECTION("Moved snapshot")
+    {
+        // Short enough to be stored inside the string object, so moving it moves the characters
+        const char* shortEnvironment[] = { "A=1", "B=", nullptr };
+        EnvironmentSnapshot original(shortEnvironment);
+        auto moved = std::make_shared<EnvironmentSnapshot>(std::move(original));
+        REQUIRE(moved->Find("A") == "1");
+        REQUIRE(moved->Find("B") == "");
+        REQUIRE(!moved->Find("C"));
+        REQUIRE(!original.Find("A"));
+
+        auto fromEnviron = std::make_shared<EnvironmentSnapshot>(EnvironmentSnapshot::FromEnviron());
+        REQUIRE(!fromEnviron->Find("EZARGS_SURELY_UNSET_VARIABLE"));
+    }
+
+    SECTION("ExpandEnvironment")
+    {
+        std::string out;
+        REQUIRE(ExpandEnvironment("plain", snapshot, out) == Error::None);
+        REQUIRE(out == "plain");
+        REQUIRE(ExpandEnvironment("${XDG_CACHE_HOME}/tool", snapshot, out) == Error::None);
+        REQUIRE(out == "/tmp/cache/tool");
+        REQUIRE(ExpandEnvironment("${HOME}${HOME}", snapshot, out) == Error::None);
+        REQUIRE(out == "/home/user/home/user");
+        REQUIRE(ExpandEnvironment("a${UNSET}b", snapshot, out) == Error::None);
+        REQUIRE(out == "ab");
+        REQUIRE(ExpandEnvironment("${UNSET:-/var/cache}/tool", snapshot, out) == Error::None);
+        REQUIRE(out == "/var/cache/tool");
+        REQUIRE(ExpandEnvironment("${EMPTY:-fallback}", snapshot, out) == Error::None);
+        REQUIRE(out == "fallback");
+        REQUIRE(ExpandEnvironment("${HOME:-fallback}", snapshot, out) == Error::None);
+        REQUIRE(out == "/home/user");
+        REQUIRE(ExpandEnvironment("$${HOME} costs $5$", snapshot, out) == Error::None);
+        REQUIRE(out == "${HOME} costs $5$");
+        REQUIRE(ExpandEnvironment("${HOME", snapshot, out) == Error::InvalidEnvironmentExpansion);
+    }
+
+    SECTION("Parse")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--cache-dir=${XDG_CACHE_HOME}/tool", "--name", "$$literal", "--bad=${HOME" });
+        ArgParser parser(std::move(errFunc));
+        std::string cacheDir;
+        std::string name;
+        std::string bad = "unchanged";
+        parser.SetOptions({
+                              {"cache-dir", SetValue(cacheDir), ""},
+                              {"name", SetValue(name), ""},
+                              {"bad", SetValue(bad), ""},
+                          });
+
+        SECTION("Disabled by default")
+        {
+            parser.ParseArgs(argc, argv);
+            REQUIRE(errors.empty());
+            REQUIRE(cacheDir == "${XDG_CACHE_HOME}/tool");
+            REQUIRE(name == "$$literal");
+        }
+
+        SECTION("Enabled")
+        {
+            parser.SetEnvironmentExpansion(std::make_shared<EnvironmentSnapshot>(environment));
+            parser.ParseArgs(argc, argv);
+            CHECK(errors.size() == 1);
+            REQUIRE(errors.front() == Error::InvalidEnvironmentExpansion);
+            REQUIRE(cacheDir == "/tmp/cache/tool");
+            REQUIRE(name == "$literal");
+            REQUIRE(bad == "unchanged");
+        }
+    }
+}
+
+TEST_CASE("Glob expansion", "[glob]")
+{
+    SECTION("GlobMatch")
+    {
+        REQUIRE(GlobMatch("*", "anything"));
+        REQUIRE(GlobMatch("*.gz", "a.gz"));
+        REQUIRE(GlobMatch("*.gz", ".gz") == false);
+        REQUIRE(GlobMatch(".*", ".hidden"));
+        REQUIRE(GlobMatch("*.gz", "a.gz.txt") == false);
+        REQUIRE(GlobMatch("a*b*c", "aXXbYYbc"));
+        REQUIRE(GlobMatch("a?c", "abc"));
+        REQUIRE(GlobMatch("a?c", "ac") == false);
+        REQUIRE(GlobMatch("[abc].txt", "b.txt"));
+        REQUIRE(GlobMatch("[a-c].txt", "c.txt"));
+        REQUIRE(GlobMatch("[a-c].txt", "d.txt") == false);
+        REQUIRE(GlobMatch("[!a-c].txt", "d.txt"));
+        REQUIRE(GlobMatch("[^a-c].txt", "a.txt") == false);
+        REQUIRE(GlobMatch("[]].txt", "].txt"));
+        REQUIRE(GlobMatch("[.txt", "[.txt"));
+        REQUIRE(GlobMatch("", ""));
+        REQUIRE(GlobMatch("", "a") == false);
+    }
+
+    namespace fs = std::filesystem;
+    fs::path root = fs::temp_directory_path() / ("ezargs-glob-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())));
+    fs::remove_all(root);
+    for (const char* dir : { "logs/2020/01", "logs/2021", "logs/.cache" }) {
+        fs::create_directories(root / dir);
+    }
+    for (const char* file : { "logs/a.gz", "logs/b.txt", "logs/2020/c.gz", "logs/2020/01/d.gz", "logs/2021/e.gz", "logs/.hidden.gz", "logs/.cache/f.gz" }) {
+        std::ofstream(root / file) << file;
+    }
+    const std::string prefix = root.generic_string() + "/";
+    auto expand = [&](const std::string& pattern, unsigned threads = 4)
+    {
+        std::vector<std::string> paths;
+        Error error = ExpandGlob(prefix + pattern, paths, threads);
+        for (auto& path : paths) {
+            path = path.substr(prefix.size());
+        }
+        return std::make_pair(error, paths);
+    };
+
+    SECTION("Single directory")
+    {
+        REQUIRE(expand("logs/*.gz") == std::make_pair(Error::None, std::vector<std::string>{ "logs/a.gz" }));
+        REQUIRE(expand("logs/?.*") == std::make_pair(Error::None, std::vector<std::string>{ "logs/a.gz", "logs/b.txt" }));
+        REQUIRE(expand("logs/.*.gz") == std::make_pair(Error::None, std::vector<std::string>{ "logs/.hidden.gz" }));
+        REQUIRE(expand("logs/*.zip") == std::make_pair(Error::GlobMatchedNothing, std::vector<std::string>{}));
+        REQUIRE(expand("missing/*.gz") == std::make_pair(Error::GlobMatchedNothing, std::vector<std::string>{}));
+    }
+
+    SECTION("Nested wildcards")
+    {
+        REQUIRE(expand("logs/*/*.gz") == std::make_pair(Error::None, std::vector<std::string>{ "logs/2020/c.gz", "logs/2021/e.gz" }));
+        REQUIRE(expand("logs/202?/01/*") == std::make_pair(Error::None, std::vector<std::string>{ "logs/2020/01/d.gz" }));
+    }
+
+    SECTION("Recursive")
+    {
+        std::vector<std::string> expected{ "logs/2020/01/d.gz", "logs/2020/c.gz", "logs/2021/e.gz", "logs/a.gz" };
+        REQUIRE(expand("logs/**/*.gz") == std::make_pair(Error::None, expected));
+        REQUIRE(expand("logs/**/**/*.gz") == std::make_pair(Error::None, expected));
+        REQUIRE(expand("logs/**/*.gz", 1) == std::make_pair(Error::None, expected));
+        REQUIRE(expand("**/d.gz") == std::make_pair(Error::None, std::vector<std::string>{ "logs/2020/01/d.gz" }));
+        REQUIRE(expand("logs/2020/**") == std::make_pair(Error::None, std::vector<std::string>{ "logs/2020/01", "logs/2020/01/d.gz", "logs/2020/c.gz" }));
+    }
+
+    SECTION("Literal patterns")
+    {
+        std::vector<std::string> paths;
+        REQUIRE(ExpandGlob("not/a/pattern.txt", paths) == Error::None);
+        REQUIRE(paths == std::vector<std::string>{ "not/a/pattern.txt" });
+    }
+
+    SECTION("Positional args and SetPaths")
+    {
+        std::vector<std::string> paths;
+        REQUIRE(ExpandGlobs({ prefix + "logs/*.txt", prefix + "logs/*.gz" }, paths) == Error::None);
+        REQUIRE(paths == std::vector<std::string>{ prefix + "logs/b.txt", prefix + "logs/a.gz" });
+
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--input", prefix + "logs/2021/*", "--input=" + prefix + "logs/*.txt", "--input", prefix + "logs/*.none" });
+        ArgParser parser(std::move(errFunc));
+        std::vector<std::string> inputs;
+        parser.SetOptions({
+                              {"input", SetPaths(inputs), ""},
+                          });
+        parser.ParseArgs(argc, argv);
+        CHECK(errors.size() == 1);
+        REQUIRE(errors.front() == Error::GlobMatchedNothing);
+        REQUIRE(inputs == std::vector<std::string>{ prefix + "logs/2021/e.gz", prefix + "logs/b.txt" });
+    }
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("Key value maps", "[map]")
+{
+    SECTION("FlatStringMap")
+    {
+        FlatStringMap map;
+        REQUIRE(map.Size() == 0);
+        REQUIRE(!map.Find("missing"));
+
+        for (unsigned i = 0; i < 100; i++) {
+            REQUIRE(map.Insert("key" + std::to_string(i), "value" + std::to_string(i)) == Error::None);
+        }
+        REQUIRE(map.Size() == 100);
+        for (unsigned i = 0; i < 100; i++) {
+            REQUIRE(map.Find("key" + std::to_string(i)) == "value" + std::to_string(i));
+        }
+        REQUIRE(!map.Find("key100"));
+
+        std::vector<std::string> keys;
+        map.ForEach([&](std::string_view key, std::string_view){ keys.push_back(std::string(key)); });
+        CHECK(keys.size() == 100);
+        REQUIRE(keys.front() == "key0");
+        REQUIRE(keys.back() == "key99");
+
+        map.Clear();
+        REQUIRE(map.Size() == 0);
+        REQUIRE(!map.Find("key0"));
+        REQUIRE(map.Insert("", "empty key") == Error::None);
+        REQUIRE(map.Find("") == "empty key");
+    }
+
+    SECTION("Duplicate key policies")
+    {
+        FlatStringMap keepFirst(DuplicateKey::KeepFirst);
+        FlatStringMap keepLast(DuplicateKey::KeepLast);
+        FlatStringMap error(DuplicateKey::Error);
+        for (FlatStringMap* map : { &keepFirst, &keepLast, &error }) {
+            REQUIRE(map->Insert("name", "first") == Error::None);
+        }
+        REQUIRE(keepFirst.Insert("name", "second") == Error::None);
+        REQUIRE(keepLast.Insert("name", "second") == Error::None);
+        REQUIRE(error.Insert("name", "second") == Error::DuplicateMapKey);
+        REQUIRE(keepFirst.Find("name") == "first");
+        REQUIRE(keepLast.Find("name") == "second");
+        REQUIRE(error.Find("name") == "first");
+        REQUIRE(keepLast.Size() == 1);
+    }
+
+    SECTION("SetMap")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "-D", "NAME=value", "-D=EMPTY=", "--define", "EQUALS=a=b", "-D", "NAME=again", "-D", "=novalue", "-D", "noequals" });
+        ArgParser parser(std::move(errFunc));
+        FlatStringMap defines(DuplicateKey::Error);
+        parser.SetOptions({
+                              {"D,define", SetMap(defines), "Defines a name=value pair"},
+                          });
+        parser.ParseArgs(argc, argv);
+        CHECK(errors.size() == 3);
+        REQUIRE(errors == std::vector<Error>{ Error::DuplicateMapKey, Error::ParameterParseError, Error::ParameterParseError });
+        REQUIRE(defines.Size() == 3);
+        REQUIRE(defines.Find("NAME") == "value");
+        REQUIRE(defines.Find("EMPTY") == "");
+        REQUIRE(defines.Find("EQUALS") == "a=b");
+    }
+}
+
+TEST_CASE("Validators", "[validators]")
+{
+    auto check = [](const Validator& validator, std::string_view parameter)
+    {
+        return CompiledValidator::Compile(validator).value().Check(parameter);
+    };
+
+    SECTION("Range")
+    {
+        REQUIRE(check(ValidateRange(1, 256), "1"));
+        REQUIRE(check(ValidateRange(1, 256), "256"));
+        REQUIRE(check(ValidateRange(1, 256), "12.5"));
+        REQUIRE(!check(ValidateRange(1, 256), "0"));
+        REQUIRE(!check(ValidateRange(1, 256), "257"));
+        REQUIRE(!check(ValidateRange(1, 256), "12abc"));
+        REQUIRE(!check(ValidateRange(1, 256), ""));
+        REQUIRE(check(ValidateRange(-1, 1), "-0.5"));
+        // Agrees with SetValue(...) on what is a number
+        REQUIRE(check(ValidateRange(1, 256), "+5"));
+        REQUIRE(check(ValidateRange(1, 256), "1e2"));
+        REQUIRE(!CompiledValidator::Compile(ValidateRange(2, 1)));
+    }
+
+    SECTION("Length")
+    {
+        REQUIRE(check(ValidateLength(0, 3), ""));
+        REQUIRE(check(ValidateLength(0, 3), "abc"));
+        REQUIRE(!check(ValidateLength(0, 3), "abcd"));
+        REQUIRE(!check(ValidateLength(2, 3), "a"));
+    }
+
+    SECTION("Characters")
+    {
+        REQUIRE(check(ValidateCharacters("a-zA-Z0-9_-"), "Valid_name-01"));
+        REQUIRE(!check(ValidateCharacters("a-zA-Z0-9_-"), "in valid"));
+        REQUIRE(check(ValidateCharacters("a-z"), ""));
+        REQUIRE(!CompiledValidator::Compile(ValidateCharacters("")));
+        REQUIRE(!CompiledValidator::Compile(ValidateCharacters("z-a")));
+    }
+
+    SECTION("Pattern")
+    {
+        Validator hostname = ValidatePattern("[a-z][a-z0-9.-]*");
+        REQUIRE(check(hostname, "example.com"));
+        REQUIRE(check(hostname, "a"));
+        REQUIRE(!check(hostname, ""));
+        REQUIRE(!check(hostname, "1example.com"));
+        REQUIRE(!check(hostname, "Example.com"));
+
+        REQUIRE(check(ValidatePattern("a+b?c*"), "a"));
+        REQUIRE(check(ValidatePattern("a+b?c*"), "aaabccc"));
+        REQUIRE(!check(ValidatePattern("a+b?c*"), "bc"));
+        REQUIRE(!check(ValidatePattern("a+b?c*"), "abbc"));
+        REQUIRE(check(ValidatePattern("v\\d+\\.\\d+"), "v1.23"));
+        REQUIRE(!check(ValidatePattern("v\\d+\\.\\d+"), "v1x23"));
+        REQUIRE(check(ValidatePattern("[^ ]*"), "no_spaces"));
+        REQUIRE(!check(ValidatePattern("[^ ]*"), "a space"));
+        REQUIRE(check(ValidatePattern(".*\\.gz"), "archive.tar.gz"));
+        REQUIRE(check(ValidatePattern(""), ""));
+        REQUIRE(!check(ValidatePattern(""), "a"));
+
+        REQUIRE(!CompiledValidator::Compile(ValidatePattern("*a")));
+        REQUIRE(!CompiledValidator::Compile(ValidatePattern("[a-z")));
+        REQUIRE(!CompiledValidator::Compile(ValidatePattern("abc\\")));
+        REQUIRE(!CompiledValidator::Compile(ValidatePattern(std::string(64, 'a'))));
+        // Needs over a million DFA states
+        std::string exponential = "[ab]*a";
+        for (int i = 0; i < 20; i++) {
+            exponential += "[ab]";
+        }
+        REQUIRE(!CompiledValidator::Compile(ValidatePattern(exponential)));
+        REQUIRE(CompiledValidator::Compile(ValidatePattern("[ab]*a[ab][ab][ab]")));
+
+        // Subset construction merges equivalent positions, so the DFA stays small
+        REQUIRE(CompiledValidator::Compile(hostname).value().GetStateCount() <= 4);
+    }
+
+    SECTION("Parse")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--threads=300", "--host", "Bad_Host", "--threads", "+8", "--host=example.com" });
+        ArgParser parser(std::move(errFunc));
+        unsigned threads = 1;
+        std::string host = "localhost";
+        parser.SetOptions({
+                              {"t,threads", SetValue(threads), "Worker threads", { ValidateRange(1, 256) }},
+                              {"h,host", SetValue(host), "Hostname", { ValidateLength(1, 253), ValidatePattern("[a-z][a-z0-9.-]*") }},
+                          });
+        REQUIRE(errors.empty());
+
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ValidationFailed, Error::ValidationFailed });
+        REQUIRE(threads == 8);
+        REQUIRE(host == "example.com");
+    }
+
+    SECTION("Invalid validator")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({});
+        (void) argc;
+        (void) argv;
+        ArgParser parser(std::move(errFunc));
+        std::string name;
+        parser.SetOptions({
+                              {"n,name", SetValue(name), "", { ValidatePattern("+"), ValidateLength(5, 1) }},
+                          });
+        REQUIRE(errors == std::vector<Error>{ Error::InvalidValidator, Error::InvalidValidator });
+    }
+}
+
+TEST_CASE("Scoped options", "[scopes]")
+{
+    struct Input {
+        std::string path;
+        std::string format = "auto";
+        bool compressed = false;
+    };
+
+    SECTION("Per input options")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--input", "a.csv", "--format", "csv", "--verbose", "--input=b.json", "-z", "--format=json", "-i", "c.txt" });
+        ArgParser parser(std::move(errFunc));
+        ScopedOptions<Input> inputs;
+        bool verbose = false;
+        parser.SetOptions({
+                              {"i,input", inputs.OpenScope(&Input::path), "Adds an input file"},
+                              {"f,format", inputs.SetValue(&Input::format), "Format of the preceding input"},
+                              {"z,compressed", inputs.DetectPresence(&Input::compressed), "The preceding input is compressed"},
+                              {"v,verbose", DetectPresence(verbose), ""},
+                          });
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(verbose);
+
+        const auto& scopes = inputs.GetScopes();
+        CHECK(scopes.size() == 3);
+        REQUIRE(scopes[0].argIndex_ == 1);
+        REQUIRE(scopes[0].values_.path == "a.csv");
+        REQUIRE(scopes[0].values_.format == "csv");
+        REQUIRE(!scopes[0].values_.compressed);
+        REQUIRE(scopes[1].argIndex_ == 6);
+        REQUIRE(scopes[1].values_.path == "b.json");
+        REQUIRE(scopes[1].values_.format == "json");
+        REQUIRE(scopes[1].values_.compressed);
+        REQUIRE(scopes[2].argIndex_ == 9);
+        REQUIRE(scopes[2].values_.path == "c.txt");
+        REQUIRE(scopes[2].values_.format == "auto");
+
+        inputs.Clear();
+        REQUIRE(inputs.GetScopes().empty());
+    }
+
+    SECTION("Defaults and options before any scope")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--format", "csv", "--input", "a" });
+        ArgParser parser(std::move(errFunc));
+        ScopedOptions<Input> inputs({ "", "tsv", true });
+        parser.SetOptions({
+                              {"input", inputs.OpenScope(&Input::path), ""},
+                              {"format", inputs.SetValue(&Input::format), ""},
+                          });
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::NoOpenScope });
+        CHECK(inputs.GetScopes().size() == 1);
+        REQUIRE(inputs.GetScopes().front().values_.format == "tsv");
+        REQUIRE(inputs.GetScopes().front().values_.compressed);
+    }
+}
+
+TEST_CASE("Configuration dump", "[dump]")
+{
+    auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--threads=4", "-v", "--name", "say \"hi\"", "-t", "8" });
+    ArgParser parser(std::move(errFunc));
+    unsigned threads = 1;
+    bool verbose = false;
+    std::string name;
+    std::string output = "out.txt";
+    parser.SetOptions({
+                          {"t,threads", SetValue(threads), ""},
+                          {"v,verbose", DetectPresence(verbose), ""},
+                          {"n,name", SetValue(name), ""},
+                          {"o,output", SetValue(output), ""},
+                      });
+
+    SECTION("Before parsing")
+    {
+        std::stringstream dump;
+        parser.DumpConfiguration(ParseResult(), dump);
+        REQUIRE(dump.str() == "threads\t# default\nverbose\t# default\nname\t# default\noutput\t# default\n");
+    }
+
+    ParseResult result;
+    parser.ParseArgs(argc, argv, result);
+    REQUIRE(errors.empty());
+
+    SECTION("Key value")
+    {
+        std::stringstream dump;
+        parser.DumpConfiguration(result, dump);
+        REQUIRE(dump.str() == "threads=8\t# argv[5]\nverbose\t# argv[2]\nname=say\\ \"hi\"\t# argv[3]\noutput\t# default\n");
+    }
+
+    SECTION("JSON lines")
+    {
+        std::stringstream dump;
+        parser.DumpConfiguration(result, dump, DumpFormat::JsonLines);
+        REQUIRE(dump.str() ==
+                "{\"option\":\"threads\",\"aliases\":\"t,threads\",\"value\":\"8\",\"source\":\"argv[5]\"}\n"
+                "{\"option\":\"verbose\",\"aliases\":\"v,verbose\",\"value\":null,\"source\":\"argv[2]\"}\n"
+                "{\"option\":\"name\",\"aliases\":\"n,name\",\"value\":\"say \\\"hi\\\"\",\"source\":\"argv[3]\"}\n"
+                "{\"option\":\"output\",\"aliases\":\"o,output\",\"value\":null,\"source\":\"default\"}\n");
+    }
+
+    SECTION("JSON lines multi-value")
+    {
+        auto&& [filesArgc, filesArgv, filesErrFunc, filesErrors] = TestHelper({ "./app/path/test.exe", "-f", "a b.txt", "c.txt", "-n", "x y" });
+        ArgParser filesParser(std::move(filesErrFunc));
+        std::vector<std::string> files;
+        filesParser.SetOptions({
+                                   {"f,files", SetValues(files), ""},
+                                   {"n,name", SetValue(name), ""},
+                               });
+        ParseResult filesResult;
+        filesParser.ParseArgs(filesArgc, filesArgv, filesResult);
+        REQUIRE(filesErrors.empty());
+        std::stringstream dump;
+        filesParser.DumpConfiguration(filesResult, dump, DumpFormat::JsonLines);
+        REQUIRE(dump.str() ==
+                "{\"option\":\"files\",\"aliases\":\"f,files\",\"value\":[\"a b.txt\",\"c.txt\"],\"source\":\"argv[1]\"}\n"
+                "{\"option\":\"name\",\"aliases\":\"n,name\",\"value\":\"x y\",\"source\":\"argv[4]\"}\n");
+    }
+
+    SECTION("Each parse has its own result")
+    {
+        auto&& [otherArgc, otherArgv, otherErrFunc, otherErrors] = TestHelper({ "./app/path/test.exe", "-o", "other.txt" });
+        (void) otherErrFunc;
+        ParseResult otherResult;
+        parser.ParseArgs(otherArgc, otherArgv, otherResult);
+        std::stringstream dump;
+        parser.DumpConfiguration(result, dump);
+        REQUIRE(dump.str() == "threads=8\t# argv[5]\nverbose\t# argv[2]\nname=say\\ \"hi\"\t# argv[3]\noutput\t# default\n");
+        std::stringstream otherDump;
+        parser.DumpConfiguration(otherResult, otherDump);
+        REQUIRE(otherDump.str() == "threads\t# default\nverbose\t# default\nname\t# default\noutput=other.txt\t# argv[1]\n");
+    }
+
+    SECTION("Rejected values are not shown")
+    {
+        auto&& [badArgc, badArgv, badErrFunc, badErrors] = TestHelper({ "./app/path/test.exe", "--threads", "2", "-t", "many" });
+        (void) badErrFunc;
+        ParseResult badResult;
+        parser.ParseArgs(badArgc, badArgv, badResult);
+        REQUIRE(errors == std::vector<Error>{ Error::ParameterParseError });
+        REQUIRE(badResult.errorCount_ == 1);
+        std::stringstream dump;
+        parser.DumpConfiguration(badResult, dump);
+        REQUIRE(dump.str() == "threads=2\t# argv[1]\nverbose\t# default\nname\t# default\noutput\t# default\n");
+    }
+
+    SECTION("Key value escaping")
+    {
+        auto&& [otherArgc, otherArgv, otherErrFunc, otherErrors] = TestHelper({ "./app/path/test.exe", "--name", "x\nadmin=1\t# argv[0]\r\x01\x7f\\" });
+        (void) otherErrFunc;
+        ParseResult otherResult;
+        parser.ParseArgs(otherArgc, otherArgv, otherResult);
+        std::stringstream dump;
+        parser.DumpConfiguration(otherResult, dump);
+        REQUIRE(dump.str() == "threads\t# default\nverbose\t# default\nname=x\\nadmin\\=1\\t#\\ argv[0]\\r\\x01\\x7f\\\\\t# argv[1]\noutput\t# default\n");
+    }
+
+    SECTION("Parses on several threads")
+    {
+        std::atomic<unsigned> errorCount = 0;
+        ArgParser shared([&](Error, const std::string&){ errorCount++; });
+        shared.SetOptions({
+                              {"n,number", OptionActionRequiredParam([](const std::string&){ return Error::None; }), "", { ValidateRange(1, 10) }},
+                              {"v,verbose", OptionActionNoParam([](){ return Error::None; }), ""},
+                          });
+        const ArgParser& constParser = shared;
+        auto&& [goodArgc, goodArgv, goodErrFunc, goodErrors] = TestHelper({ "./app/path/test.exe", "--number", "5", "-v" });
+        auto&& [badArgc, badArgv, badErrFunc, badErrors] = TestHelper({ "./app/path/test.exe", "--number=50" });
+        (void) goodErrFunc;
+        (void) badErrFunc;
+
+        auto parse = [&, goodArgc = goodArgc, goodArgv = goodArgv, badArgc = badArgc, badArgv = badArgv](bool good)
+        {
+            bool consistent = true;
+            for (int i = 0; i < 200; i++) {
+                ParseResult threadResult;
+                constParser.ParseArgs(good ? goodArgc : badArgc, good ? goodArgv : badArgv, threadResult);
+                std::stringstream dump;
+                constParser.DumpConfiguration(threadResult, dump);
+                if (good) {
+                    consistent = consistent && threadResult.errorCount_ == 0 && dump.str() == "number=5\t# argv[1]\nverbose\t# argv[3]\n";
+                } else {
+                    consistent = consistent && threadResult.errorCount_ == 1 && threadResult.args_.empty();
+                }
+            }
+            return consistent;
+        };
+        auto goodParses = std::async(std::launch::async, parse, true);
+        auto badParses = std::async(std::launch::async, parse, false);
+        REQUIRE(goodParses.get());
+        REQUIRE(badParses.get());
+        REQUIRE(errorCount == 200);
+    }
+
+    SECTION("Larger than the buffer")
+    {
+        std::stringstream out;
+        {
+            DumpWriter writer(out);
+            writer << std::string(3000, 'a') << std::string(3000, 'b') << std::string(5000, 'c');
+            writer.WriteJsonEscaped("\n");
+        }
+        REQUIRE(out.str() == std::string(3000, 'a') + std::string(3000, 'b') + std::string(5000, 'c') + "\\u000a");
+    }
+}
+
+TEST_CASE("Alias resolver", "[resolver]")
+{
+    auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "-v", "--pluginA-level", "3", "--pluginA-level=4", "--unknown", "--pluginB-name=b" });
+    unsigned tokeniseCount = 0;
+    ArgsTokeniser posixTokeniser = GetDefaultPosixArgsTokeniser();
+    ArgParser parser(std::move(errFunc), [&](int argc, char** argv, const ArgErrorHandler& errorFunc, const ValueCountLookup& maxValues) -> ParsedArgs
+    {
+        tokeniseCount++;
+        return posixTokeniser(argc, argv, errorFunc, maxValues);
+    });
+    bool verbose = false;
+    int level = 0;
+    std::string name;
+    std::vector<std::string> resolved;
+    parser.SetOptions({
+                          {"v,verbose", DetectPresence(verbose), ""},
+                      });
+    parser.SetAliasResolver([&](const std::string& alias) -> std::vector<Option>
+    {
+        resolved.push_back(alias);
+        if (alias.rfind("pluginA-", 0) == 0) {
+            return { {"pluginA-level", SetValue(level), "Plugin A's level"} };
+        } else if (alias.rfind("pluginB-", 0) == 0) {
+            return { {"pluginB-name", SetValue(name), "Plugin B's name"} };
+        }
+        return {};
+    });
+
+    TokenisedArgs tokenisedArgs = parser.Tokenise(argc, argv);
+    parser.ResolveAliases(tokenisedArgs);
+    REQUIRE(errors.empty());
+    parser.ParseArgs(argc, argv, tokenisedArgs);
+    REQUIRE(tokeniseCount == 1);
+
+    REQUIRE(verbose);
+    REQUIRE(level == 4);
+    REQUIRE(name == "b");
+    REQUIRE(resolved == std::vector<std::string>{ "pluginA-level", "unknown", "pluginB-name" });
+    REQUIRE(errors.size() == 1);
+    REQUIRE(errors.front() == Error::UnrecognisedAlias);
+
+    std::stringstream help;
+    parser.PrintHelpTable(help);
+    REQUIRE(help.str().find("Plugin B's name") != std::string::npos);
+
+    SECTION("AddOptions")
+    {
+        errors.clear();
+        parser.AddOptions({ {"unknown", DetectPresence(verbose), ""}, {"v", DetectPresence(verbose), ""} });
+        REQUIRE(errors.size() == 1);
+        REQUIRE(errors.front() == Error::AliasClash);
+        errors.clear();
+        resolved.clear();
+        parser.ResolveAliases(tokenisedArgs);
+        parser.ParseArgs(argc, argv, tokenisedArgs);
+        REQUIRE(errors.empty());
+        REQUIRE(resolved.empty());
+    }
+
+    // ParseArgs(...) is const, so leaves resolving to ResolveAliases(...)
+    SECTION("Not resolved while parsing")
+    {
+        auto&& [otherArgc, otherArgv, otherErrFunc, otherErrors] = TestHelper({ "./app/path/test.exe", "--pluginC-flag" });
+        (void) otherErrFunc;
+        resolved.clear();
+        errors.clear();
+        parser.ParseArgs(otherArgc, otherArgv);
+        REQUIRE(resolved.empty());
+        REQUIRE(errors == std::vector<Error>{ Error::UnrecognisedAlias });
+    }
+}
+
+TEST_CASE("Bootstrap pre-parse", "[bootstrap]")
+{
+    auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--config", "app.ini", "-vq", "--log-level=debug", "--threads", "4", "--", "positional" });
+    unsigned tokeniseCount = 0;
+    ArgsParser posixParser = GetDefaultPosixArgsParser();
+    ArgParser bootstrap(std::move(errFunc), [&](int argc, char** argv, const ErrorHandler& errorFunc) -> ParsedArgs
+    {
+        tokeniseCount++;
+        return posixParser(argc, argv, errorFunc);
+    });
+    std::string config;
+    std::string logLevel;
+    bootstrap.SetOptions({
+                             {"config", SetValue(config), ""},
+                             {"log-level", SetValue(logLevel), ""},
+                         });
+
+    TokenisedArgs tokenisedArgs = bootstrap.Tokenise(argc, argv);
+    bootstrap.ParseKnownArgs(argc, argv, tokenisedArgs);
+
+    REQUIRE(tokeniseCount == 1);
+    REQUIRE(errors.empty());
+    REQUIRE(config == "app.ini");
+    REQUIRE(logLevel == "debug");
+
+    SECTION("Hand off to full parse")
+    {
+        std::vector<Error> mainErrors;
+        ArgParser parser([&](Error error, const std::string&){ mainErrors.push_back(error); });
+        bool verbose = false;
+        bool quiet = false;
+        unsigned threads = 0;
+        parser.SetOptions({
+                              {"config", SetValue(config), ""},
+                              {"log-level", SetValue(logLevel), ""},
+                              {"v,verbose", DetectPresence(verbose), ""},
+                              {"q,quiet", DetectPresence(quiet), ""},
+                              {"t,threads", SetValue(threads), ""},
+                          });
+        const TokenisedArgs copy = tokenisedArgs;
+        auto positionalArgs = parser.ParseArgs(argc, argv, tokenisedArgs);
+        // Shared, not consumed
+        REQUIRE(tokenisedArgs.parsedArgs_ == copy.parsedArgs_);
+        REQUIRE(tokenisedArgs.positionalArgs_ == copy.positionalArgs_);
+
+        REQUIRE(tokeniseCount == 1);
+        REQUIRE(mainErrors.empty());
+        REQUIRE(verbose);
+        REQUIRE(quiet);
+        REQUIRE(threads == 4);
+        REQUIRE(positionalArgs == std::vector<std::string>{ "positional" });
+
+        std::string moved;
+        ArgParser mover([&](Error error, const std::string&){ mainErrors.push_back(error); });
+        mover.SetOptions({
+                             {"config", MoveValue(moved), ""},
+                             {"log-level", MoveValue(moved), ""},
+                             {"v,verbose", DetectPresence(verbose), ""},
+                             {"q,quiet", DetectPresence(quiet), ""},
+                             {"t,threads", MoveValue(moved), ""},
+                         });
+        mover.ParseArgs(argc, argv, tokenisedArgs);
+        REQUIRE(mainErrors.empty());
+        REQUIRE(moved == "4");
+        REQUIRE(tokenisedArgs.parsedArgs_ == copy.parsedArgs_);
+        REQUIRE(tokenisedArgs.positionalArgs_ == copy.positionalArgs_);
+    }
+
+    SECTION("Known arg errors still reported")
+    {
+        bool configPresent = false;
+        bootstrap.SetOptions({
+                                 {"config", DetectPresence(configPresent), ""},
+                             });
+        bootstrap.ParseKnownArgs(argc, argv, tokenisedArgs);
+        REQUIRE(errors == std::vector<Error>{ Error::UnexpectedParameter });
+    }
+
+    SECTION("Tokenising errors reported by every parse")
+    {
+        ArgvBuffer args{ "./app/path/test.exe", "--config", "app.ini", "-1" };
+        ArgParser known([&](Error error, const std::string&){ errors.push_back(error); });
+        known.SetOptions({
+                             {"config", SetValue(config), ""},
+                         });
+        TokenisedArgs shared = known.Tokenise(args.Argc(), args.Argv());
+        known.ParseKnownArgs(args.Argc(), args.Argv(), shared);
+        REQUIRE(errors.empty());
+        REQUIRE(shared.errors_.size() == 1);
+        REQUIRE(shared.errors_[0].argIndex_ == 3);
+
+        std::vector<Error> mainErrors;
+        ArgParser parser([&](Error error, const std::string&){ mainErrors.push_back(error); });
+        parser.SetOptions({
+                              {"config", SetValue(config), ""},
+                          });
+        for (int parse = 1; parse <= 2; parse++) {
+            ParseResult result;
+            parser.ParseArgs(args.Argc(), args.Argv(), shared, result);
+            REQUIRE(result.errorCount_ == 1);
+            REQUIRE(mainErrors == std::vector<Error>(static_cast<std::size_t>(parse), Error::ExpectedShortAlias));
+        }
+    }
+
+    SECTION("Values of unknown Options kept together")
+    {
+        ArgvBuffer args{ "./app/path/test.exe", "--config", "app.ini", "--files", "a", "b", "--name", "x", "y" };
+        ArgParser known(GetDefaultPosixArgsTokeniser());
+        known.SetOptions({
+                             {"config", SetValue(config), ""},
+                         });
+        TokenisedArgs shared = known.Tokenise(args.Argc(), args.Argv());
+        known.ParseKnownArgs(args.Argc(), args.Argv(), shared);
+        REQUIRE(config == "app.ini");
+
+        std::vector<Error> mainErrors;
+        ArgParser parser([&](Error error, const std::string&){ mainErrors.push_back(error); });
+        std::vector<std::string> files;
+        std::string name;
+        parser.SetOptions({
+                              {"config", SetValue(config), ""},
+                              {"files", SetValues(files), ""},
+                              {"name", SetValue(name), ""},
+                          });
+        parser.ParseArgs(args.Argc(), args.Argv(), shared);
+        REQUIRE(files == std::vector<std::string>{ "a", "b" });
+        REQUIRE(mainErrors == std::vector<Error>{ Error::WrongParameterCount });
+    }
+}
+
+TEST_CASE("Move-through parameters", "[move]")
+{
+    auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--json", "{}", "--view", "abc", "--copy", "def" });
+    const std::string json = "{\"paths\":[" + std::string(4096, 'x') + "]}";
+    const char* tokenisedData = nullptr;
+    ArgsParser posixParser = GetDefaultPosixArgsParser();
+    ArgParser parser(std::move(errFunc), [&](int argc, char** argv, const ErrorHandler& errorFunc) -> ParsedArgs
+    {
+        auto tokenisedArgs = posixParser(argc, argv, errorFunc);
+        std::get<2>(std::get<0>(tokenisedArgs).front()) = json;
+        tokenisedData = std::get<2>(std::get<0>(tokenisedArgs).front())->data();
+        return tokenisedArgs;
+    });
+
+    std::string moved;
+    // A view of the parameter is only valid while the action runs
+    std::string viewed;
+    std::string copied;
+    parser.SetOptions({
+                          {"json", MoveValue(moved), ""},
+                          {"view", OptionActionRequiredParam([&](std::string_view parameter){ viewed = parameter; return Error::None; }), ""},
+                          {"copy", SetValue(copied), ""},
+                          {"other", MoveValue(moved), ""},
+                      });
+    ParseResult result;
+    parser.ParseArgs(argc, argv, result);
+
+    REQUIRE(errors.empty());
+    REQUIRE(moved == json);
+    REQUIRE(moved.data() == tokenisedData);
+    REQUIRE(viewed == "abc");
+    REQUIRE(copied == "def");
+
+    std::stringstream dump;
+    parser.DumpConfiguration(result, dump);
+    REQUIRE(dump.str() == "json\t# argv[1] (moved)\n"
+                          "view=abc\t# argv[3]\n"
+                          "copy=def\t# argv[5]\n"
+                          "other\t# default\n");
+
+    SECTION("Direct use of a moving action copies")
+    {
+        std::string out;
+        OptionAction action = MoveValue(out);
+        std::optional<std::string> parameter = "value";
+        REQUIRE(action.TakesOwnership());
+        REQUIRE(action.GetParameterRequirements() == Parameter::Required);
+        REQUIRE(action.GetAction()(parameter) == Error::None);
+        REQUIRE(parameter == "value");
+        REQUIRE(action.GetAction()(std::nullopt) == Error::ExpectedParameter);
+        REQUIRE(action.Invoke(parameter) == Error::None);
+        REQUIRE(out == "value");
+    }
+}
+
+TEST_CASE("Constraints", "[constraints]")
+{
+    int min = 0;
+    int max = 100;
+    unsigned threads = 1;
+    unsigned maxThreads = 8;
+    unsigned width = 16;
+    unsigned height = 16;
+    auto setOptions = [&](ArgParser& parser)
+    {
+        parser.SetOptions({
+                              {"min", SetValue(min), ""},
+                              {"max", SetValue(max), ""},
+                              {"t,threads", SetValue(threads), ""},
+                              {"max-threads", SetValue(maxThreads), ""},
+                              {"w,width", SetValue(width), ""},
+                              {"h,height", SetValue(height), ""},
+                          });
+        parser.SetConstraints({
+                                  ConstrainOrder("min", min, "max", max),
+                                  ConstrainOrder("threads", threads, "max-threads", maxThreads),
+                                  ConstrainValues({ "w", "h" }, [](unsigned w, unsigned h){ return w * h <= 4096; }, width, height),
+                                  ConstrainOrder("max-threads", maxThreads, "threads", threads, std::greater_equal<>{}),
+                              });
+    };
+
+    SECTION("Satisfied")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--min", "5", "--max=10", "-t", "4", "-w", "64", "-h", "64" });
+        ArgParser parser(std::move(errFunc));
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(min == 5);
+        REQUIRE(max == 10);
+    }
+
+    SECTION("Violated, every involved arg reported")
+    {
+        std::vector<std::string> wheres;
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--max", "3", "-t", "2", "--min=5" });
+        (void) errFunc;
+        ArgParser parser([&](Error error, const std::string& where){ errors.push_back(error); wheres.push_back(where); });
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ConstraintViolated });
+        REQUIRE(wheres.front() == "./app/path/test.exe --max 3 -t 2 --min=5 \n"
+                                  "                    ^            ^\n"
+                                  "{ min, max }");
+    }
+
+    SECTION("Violated by defaults")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "-w", "128" });
+        ArgParser parser(std::move(errFunc));
+        height = 64;
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ConstraintViolated });
+    }
+
+    SECTION("Skipped after conversion failure, every violation reported")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--min", "x", "--max=2", "-t", "12" });
+        ArgParser parser(std::move(errFunc));
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        // min failed to parse, so min <= max is not checked, both threads
+        // constraints are violated
+        REQUIRE(errors == std::vector<Error>{ Error::ParameterParseError, Error::ConstraintViolated, Error::ConstraintViolated });
+    }
+
+    SECTION("Unknown alias")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--min", "5", "--max", "3" });
+        ArgParser parser(std::move(errFunc));
+        setOptions(parser);
+        REQUIRE(errors.empty());
+        parser.SetConstraints({ ConstrainOrder("min", min, "maximum", max), ConstrainOrder("min", min, "max", max) });
+        REQUIRE(errors == std::vector<Error>{ Error::UnrecognisedAlias });
+        parser.ParseArgs(argc, argv);
+        // Only the valid Constraint was kept
+        REQUIRE(errors == std::vector<Error>{ Error::UnrecognisedAlias, Error::ConstraintViolated });
+    }
+
+    SECTION("Options replaced after the Constraints")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--min", "5", "--max", "3" });
+        ArgParser parser(std::move(errFunc));
+        setOptions(parser);
+        parser.SetOptions({
+                              {"min", SetValue(min), ""},
+                              {"max", SetValue(max), ""},
+                          });
+        parser.ParseArgs(argc, argv);
+        // Each stale Constraint is reported once and skipped
+        REQUIRE(errors == std::vector<Error>{ Error::ConstraintViolated, Error::UnrecognisedAlias, Error::UnrecognisedAlias, Error::UnrecognisedAlias });
+        REQUIRE(min == 5);
+        REQUIRE(max == 3);
+    }
+}
+
+TEST_CASE("Configuration snapshots", "[snapshots]")
+{
+    struct Config {
+        int low = 0;
+        int high = 0;
+        std::string name = "initial";
+        bool verbose = false;
+    };
+
+    std::vector<Error> errors;
+    ArgParser parser([&](Error error, const std::string&){ errors.push_back(error); });
+    ConfigSnapshots<Config> snapshots;
+    parser.SetOptions({
+                          {"l,low", snapshots.SetValue(&Config::low), ""},
+                          {"h,high", snapshots.SetValue(&Config::high), ""},
+                          {"n,name", snapshots.SetValue(&Config::name), ""},
+                          {"v,verbose", snapshots.DetectPresence(&Config::verbose), ""},
+                      });
+
+    REQUIRE(snapshots.Read()->name == "initial");
+
+    SECTION("Publish on success only")
+    {
+        auto&& [argc, argv, errFunc, unused] = TestHelper({ "./app/path/test.exe", "-l", "1", "--high=2", "-v" });
+        (void) errFunc;
+        snapshots.ParseArgs(parser, argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(snapshots.GetPublishCount() == 1);
+        {
+            auto snapshot = snapshots.Read();
+            REQUIRE(snapshot->low == 1);
+            REQUIRE(snapshot->high == 2);
+            REQUIRE(snapshot->verbose);
+            REQUIRE(snapshot->name == "initial");
+        }
+
+        auto&& [argc2, argv2, errFunc2, unused2] = TestHelper({ "./app/path/test.exe", "-l", "5", "--high=x" });
+        (void) errFunc2;
+        snapshots.ParseArgs(parser, argc2, argv2);
+        REQUIRE(errors == std::vector<Error>{ Error::ParameterParseError });
+        REQUIRE(snapshots.GetPublishCount() == 1);
+        REQUIRE(snapshots.Read()->low == 1);
+    }
+
+    SECTION("Concurrent readers see whole snapshots")
+    {
+        std::atomic<bool> stop = false;
+        std::atomic<unsigned> torn = 0;
+        std::atomic<unsigned long> reads = 0;
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; i++) {
+            readers.emplace_back([&]()
+            {
+                while (!stop) {
+                    auto snapshot = snapshots.Read();
+                    bool initial = snapshot->name == "initial";
+                    if (!initial && (snapshot->high != snapshot->low * 2 || snapshot->name != "n" + std::to_string(snapshot->low))) {
+                        torn++;
+                    }
+                    reads++;
+                }
+            });
+        }
+        for (int i = 1; i <= 200; i++) {
+            std::string low = std::to_string(i);
+            std::string high = std::to_string(i * 2);
+            auto&& [argc, argv, errFunc, unused] = TestHelper({ "./app/path/test.exe", "-l", low, "-h", high, "-n", "n" + low });
+            (void) errFunc;
+            snapshots.ParseArgs(parser, argc, argv);
+        }
+        stop = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(errors.empty());
+        REQUIRE(torn == 0);
+        REQUIRE(snapshots.GetPublishCount() == 200);
+        REQUIRE(snapshots.Read()->low == 200);
+    }
+}
+
+TEST_CASE("Multi-value options", "[values]")
+{
+    std::array<int, 3> point = { 0, 0, 0 };
+    std::tuple<int, double> range = { 0, 0.0 };
+    std::vector<std::string> files;
+    std::string name;
+    bool verbose = false;
+    auto setOptions = [&](ArgParser& parser)
+    {
+        parser.SetOptions({
+                              {"p,point", SetValues(point), ""},
+                              {"r,range", SetValues(range), ""},
+                              {"f,files", SetValues(files, 1, 3), "", { ValidateLength(1, 8) }},
+                              {"n,name", SetValue(name), ""},
+                              {"v,verbose", DetectPresence(verbose), ""},
+                          });
+    };
+
+    SECTION("Bound in a single pass")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--point", "1", "2", "3", "-r=10", "20.5", "-vf", "a.txt", "b.txt", "--name", "x" });
+        ArgParser parser(std::move(errFunc));
+        setOptions(parser);
+        ParseResult result;
+        parser.ParseArgs(argc, argv, result);
+        REQUIRE(errors.empty());
+        REQUIRE(point == std::array<int, 3>{ 1, 2, 3 });
+        REQUIRE(range == std::tuple<int, double>{ 10, 20.5 });
+        REQUIRE(files == std::vector<std::string>{ "a.txt", "b.txt" });
+        REQUIRE(verbose);
+        REQUIRE(name == "x");
+
+        std::stringstream dump;
+        parser.DumpConfiguration(result, dump);
+        REQUIRE(dump.str().find("point=1 2 3\t# argv[1]\n") != std::string::npos);
+    }
+
+    SECTION("Wrong count")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--point", "1", "2", "-f", "a", "b", "c", "d" });
+        ArgParser parser(std::move(errFunc));
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ExpectedAliasIndicator, Error::WrongParameterCount });
+        REQUIRE(point == std::array<int, 3>{ 0, 0, 0 });
+        REQUIRE(files == std::vector<std::string>{ "a", "b", "c" });
+    }
+
+    SECTION("Zero values")
+    {
+        std::vector<std::string> tags = { "old" };
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--tags", "-v" });
+        ArgParser parser(std::move(errFunc));
+        parser.SetOptions({
+                              {"t,tags", SetValues(tags, 0), ""},
+                              {"v,verbose", DetectPresence(verbose), ""},
+                          });
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(tags.empty());
+        REQUIRE(verbose);
+        REQUIRE(SetValues(tags, 0).GetParameterRequirements() == Parameter::Optional);
+
+        auto&& [argc2, argv2, errFunc2, errors2] = TestHelper({ "./app/path/test.exe", "-t", "a", "b" });
+        ArgParser second(std::move(errFunc2));
+        second.SetOptions({ {"t,tags", SetValues(tags, 0), ""} });
+        second.ParseArgs(argc2, argv2);
+        REQUIRE(errors2.empty());
+        REQUIRE(tags == std::vector<std::string>{ "a", "b" });
+    }
+
+    SECTION("Values beyond the most an Option takes")
+    {
+        std::vector<std::string> wheres;
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--point=1", "2", "3", "4", "-f", "a", "b", "c", "d" });
+        (void) errFunc;
+        ArgParser parser([&](Error error, const std::string& where){ errors.push_back(error); wheres.push_back(where); });
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ExpectedAliasIndicator, Error::ExpectedAliasIndicator });
+        REQUIRE(wheres[0] == PointToArg(argc, argv, 4));
+        REQUIRE(wheres[1] == PointToArg(argc, argv, 9));
+        REQUIRE(point == std::array<int, 3>{ 1, 2, 3 });
+    }
+
+    SECTION("Every value parsed and validated")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--point", "1", "x", "3", "-f", "a", "much-too-long" });
+        ArgParser parser(std::move(errFunc));
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ParameterParseError, Error::ValidationFailed });
+        REQUIRE(point == std::array<int, 3>{ 0, 0, 0 });
+    }
+
+    SECTION("Extra values for single value Options")
+    {
+        std::vector<std::string> wheres;
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--name", "x", "y", "--name=a", "b" });
+        (void) errFunc;
+        ArgParser parser([&](Error error, const std::string& where){ errors.push_back(error); wheres.push_back(where); });
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ExpectedAliasIndicator, Error::ExpectedAliasIndicator });
+        REQUIRE(wheres[0] == PointToArg(argc, argv, 3));
+        REQUIRE(wheres[1] == PointToArg(argc, argv, 5));
+        REQUIRE(name == "a");
+    }
+
+    SECTION("Default args parser takes one value per alias")
+    {
+        auto&& [argc, argv, errFunc, errors] = TestHelper({ "./app/path/test.exe", "--point", "1", "2", "3" });
+        ArgParser parser(std::move(errFunc), GetDefaultPosixArgsParser());
+        setOptions(parser);
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::ExpectedAliasIndicator, Error::ExpectedAliasIndicator, Error::WrongParameterCount });
+    }
+}
+
+TEST_CASE("ArgvBuffer", "[argv]")
+{
+    ArgvBuffer args{ "./app/path/test.exe", "-v", "--name", "first" };
+    REQUIRE(args.Argc() == 4);
+    REQUIRE(std::string(args.Argv()[2]) == "--name");
+    REQUIRE(args.Argv()[4] == nullptr);
+    REQUIRE(args.Argv()[3] + 6 == args.Argv()[2] + 13);
+
+    std::vector<Error> errors;
+    ArgParser parser([&](Error error, const std::string&){ errors.push_back(error); });
+    bool verbose = false;
+    std::string name;
+    parser.SetOptions({
+                          {"v,verbose", DetectPresence(verbose), ""},
+                          {"n,name", SetValue(name), ""},
+                      });
+    parser.ParseArgs(args.Argc(), args.Argv());
+    REQUIRE(errors.empty());
+    REQUIRE(verbose);
+    REQUIRE(name == "first");
+
+    SECTION("Reuse without reallocating")
+    {
+        char* block = args.Argv()[0];
+        char** pointers = args.Argv();
+        args.Reset();
+        REQUIRE(args.Argc() == 0);
+        REQUIRE(args.Argv()[0] == nullptr);
+        args.Append("./app/path/test.exe");
+        args.Append("--name=second");
+        REQUIRE(args.Argv() == pointers);
+        REQUIRE(args.Argv()[0] == block);
+        parser.ParseArgs(args.Argc(), args.Argv());
+        REQUIRE(name == "second");
+    }
+
+    SECTION("Copies own their args")
+    {
+        ArgvBuffer copy = args;
+        args.Reset();
+        args.Append(std::string_view("embedded\0nul", 12));
+        REQUIRE(copy.Argc() == 4);
+        REQUIRE(copy[3] == "first");
+        REQUIRE(std::string(copy.Argv()[3]) == "first");
+        REQUIRE(args[0] == "embedded");
+    }
+
+    SECTION("Moves keep their args")
+    {
+        char** argv = args.Argv();
+        ArgvBuffer moved = std::move(args);
+        REQUIRE(moved.Argv() == argv);
+        REQUIRE(args.Argc() == 0);
+        REQUIRE(args.Argv()[0] == nullptr);
+
+        std::vector<ArgvBuffer> buffers;
+        buffers.push_back(std::move(moved));
+        buffers.emplace_back(ArgvBuffer{ "./app/path/test.exe", "--name", "second" });
+        parser.ParseArgs(buffers[0].Argc(), buffers[0].Argv());
+        REQUIRE(name == "first");
+        parser.ParseArgs(buffers[1].Argc(), buffers[1].Argv());
+        REQUIRE(name == "second");
+
+        args = std::move(buffers[0]);
+        REQUIRE(args.Argc() == 4);
+        REQUIRE(std::string(args.Argv()[2]) == "--name");
+        REQUIRE(buffers[0].Argc() == 0);
+    }
+}
+
+TEST_CASE("Dotted option namespaces", "[namespaces]")
+{
+    struct Pool {
+        unsigned size = 4;
+        double timeout = 1.5;
+    };
+    struct Db {
+        std::string host = "localhost";
+        Pool pool;
+        Pool replicaPool;
+    };
+    struct Config {
+        Db db;
+        bool verbose = false;
+    };
+
+    Config config;
+    std::vector<Error> errors;
+    ArgParser parser([&](Error error, const std::string&){ errors.push_back(error); });
+    std::vector<FieldBinding<Pool>> poolFields = { Field("size", &Pool::size, "Connections"), Field("timeout", &Pool::timeout, "Seconds") };
+    std::vector<Option> options = BindFields("db", config.db, {
+                                                 Field("host", &Db::host, "Database host"),
+                                                 Field("pool", &Db::pool, { Field("size", &Pool::size, "Connections"), Field("timeout", &Pool::timeout, "Seconds") }),
+                                                 Field("replica", &Db::replicaPool, poolFields),
+                                             });
+    REQUIRE(options.size() == 5);
+    parser.SetOptions(std::move(options));
+
+    SECTION("Bound to nested members")
+    {
+        auto&& [argc, argv, errFunc, unused] = TestHelper({ "./app/path/test.exe", "--db.pool.size", "16", "--db.replica.timeout=0.25", "--db.host", "db1", "--db.pool.sizes=1", "--db.pool=2" });
+        (void) errFunc;
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::UnrecognisedAlias, Error::UnrecognisedAlias });
+        REQUIRE(config.db.pool.size == 16);
+        REQUIRE(config.db.pool.timeout == 1.5);
+        REQUIRE(config.db.replicaPool.timeout == 0.25);
+        REQUIRE(config.db.host == "db1");
+    }
+
+    SECTION("Subtree help")
+    {
+        parser.AddOptions({ {"h,help", PrintHelpFor(parser, false, std::cout), ""} });
+        std::stringstream help;
+        REQUIRE(parser.PrintHelpTableFor("db.pool", help));
+        REQUIRE(help.str().find("db.pool.size") != std::string::npos);
+        REQUIRE(help.str().find("db.pool.timeout") != std::string::npos);
+        REQUIRE(help.str().find("db.host") == std::string::npos);
+        REQUIRE(help.str().find("db.replica") == std::string::npos);
+
+        help.str("");
+        REQUIRE(parser.PrintHelpTableFor("db.*.timeout", help));
+        REQUIRE(help.str().find("db.pool.timeout") != std::string::npos);
+        REQUIRE(help.str().find("db.replica.timeout") != std::string::npos);
+        REQUIRE(help.str().find("size") == std::string::npos);
+
+        REQUIRE_FALSE(parser.PrintHelpTableFor("db.cache", help));
+
+        auto&& [argc, argv, errFunc, unused] = TestHelper({ "./app/path/test.exe", "--help=db.cache" });
+        (void) errFunc;
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors == std::vector<Error>{ Error::UnrecognisedAlias });
+    }
+
+    SECTION("Subtree help with a compiled schema")
+    {
+        parser.AddOptions({ {"h,help", PrintHelpFor(parser, false, std::cout), ""} });
+        std::vector<char> blob = parser.CompileSchema();
+
+        std::stringstream help;
+        ArgParser bound([&](Error error, const std::string&){ errors.push_back(error); });
+        std::vector<OptionAction> actions;
+        for (const Option& option : BindFields("db", config.db, { Field("host", &Db::host, "Database host"), Field("pool", &Db::pool, poolFields), Field("replica", &Db::replicaPool, poolFields) })) {
+            actions.push_back(option.onParse_);
+        }
+        actions.push_back(PrintHelpFor(bound, false, help));
+        bound.SetOptions(CompiledSchema(blob.data(), blob.size()), std::move(actions));
+        REQUIRE(errors.empty());
+
+        REQUIRE(bound.PrintHelpTableFor("db.*.timeout", help));
+        REQUIRE(help.str().find("db.replica.timeout") != std::string::npos);
+
+        help.str("");
+        auto&& [argc, argv, errFunc, unused] = TestHelper({ "./app/path/test.exe", "--help=db.pool" });
+        (void) errFunc;
+        bound.ParseArgs(argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(help.str().find("db.pool.size") != std::string::npos);
+        REQUIRE(help.str().find("db.host") == std::string::npos);
+    }
+
+    SECTION("Added Options are indexed")
+    {
+        bool verbose = false;
+        parser.AddOptions({ {"log.verbose", DetectPresence(verbose), ""} });
+        auto&& [argc, argv, errFunc, unused] = TestHelper({ "./app/path/test.exe", "--log.verbose" });
+        (void) errFunc;
+        parser.ParseArgs(argc, argv);
+        REQUIRE(errors.empty());
+        REQUIRE(verbose);
+    }
+
+    SECTION("Empty segments")
+    {
+        bool unused = false;
+        parser.AddOptions({
+                              {"a..b", DetectPresence(unused), ""},
+                              {".a", DetectPresence(unused), ""},
+                              {"a.", DetectPresence(unused), ""},
+                              {"db.host", DetectPresence(unused), ""},
+                          });
+        REQUIRE(errors == std::vector<Error>{ Error::EmptyAlias, Error::EmptyAlias, Error::EmptyAlias, Error::AliasClash });
+    }
+}
+
+TEST_CASE("Audit log", "[audit]")
+{
+    namespace fs = std::filesystem;
+    fs::path path = fs::temp_directory_path() / ("ezargs-audit-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".log");
+    fs::remove(path);
+
+    std::vector<Error> errors;
+    ArgParser parser([&](Error error, const std::string&){ errors.push_back(error); });
+    int number = 0;
+    bool verbose = false;
+    parser.SetOptions({
+                          {"n,number", SetValue(number), ""},
+                          {"v,verbose", DetectPresence(verbose), ""},
+                      });
+    auto auditLog = std::make_shared<AuditLog>(path);
+    REQUIRE(auditLog->IsOpen());
+    parser.SetAuditLog(auditLog);
+
+    ArgvBuffer success{ "./app/path/test.exe", "-v", "--number", "4" };
+    ArgvBuffer badValue{ "./app/path/test.exe", "-v", "--number=x", "--unknown" };
+    ArgvBuffer badToken{ "./app/path/test.exe", "-v", "-1" };
+    parser.ParseArgs(success.Argc(), success.Argv());
+    parser.ParseArgs(badValue.Argc(), badValue.Argv());
+    parser.ParseArgs(badToken.Argc(), badToken.Argv());
+    REQUIRE(errors == std::vector<Error>{ Error::ParameterParseError, Error::UnrecognisedAlias, Error::ExpectedShortAlias });
+
+    std::vector<AuditRecord> records = AuditLog::ReadFile(path);
+    REQUIRE(records.size() == 3);
+    REQUIRE(records[0].error_ == Error::None);
+    REQUIRE(records[0].errorArgIndex_ == -1);
+    REQUIRE(records[0].args_ == std::vector<std::string>{ "./app/path/test.exe", "-v", "--number", "4" });
+    REQUIRE(records[1].error_ == Error::ParameterParseError);
+    REQUIRE(records[1].errorArgIndex_ == 2);
+    REQUIRE(records[2].error_ == Error::ExpectedShortAlias);
+    REQUIRE(records[2].errorArgIndex_ == 2);
+    REQUIRE(records[0].timestamp_ <= records[2].timestamp_);
+    REQUIRE(records[0].processId_ == records[2].processId_);
+
+    SECTION("One record per bootstrap and full parse")
+    {
+        ArgParser bootstrap([&](Error error, const std::string&){ errors.push_back(error); });
+        bootstrap.SetOptions({
+                                 {"n,number", SetValue(number), ""},
+                             });
+        bootstrap.SetAuditLog(auditLog);
+
+        ArgvBuffer known{ "./app/path/test.exe", "--number", "6", "-v" };
+        TokenisedArgs tokenisedArgs = bootstrap.Tokenise(known.Argc(), known.Argv());
+        bootstrap.ParseKnownArgs(known.Argc(), known.Argv(), tokenisedArgs);
+        REQUIRE(number == 6);
+        REQUIRE(AuditLog::ReadFile(path).size() == 3);
+        parser.ParseArgs(known.Argc(), known.Argv(), tokenisedArgs);
+        records = AuditLog::ReadFile(path);
+        REQUIRE(records.size() == 4);
+        REQUIRE(records[3].error_ == Error::None);
+        REQUIRE(records[3].args_ == std::vector<std::string>{ "./app/path/test.exe", "--number", "6", "-v" });
+
+        ArgvBuffer malformed{ "./app/path/test.exe", "--number", "x", "-1" };
+        tokenisedArgs = bootstrap.Tokenise(malformed.Argc(), malformed.Argv());
+        bootstrap.ParseKnownArgs(malformed.Argc(), malformed.Argv(), tokenisedArgs);
+        ParseResult result;
+        parser.ParseArgs(malformed.Argc(), malformed.Argv(), tokenisedArgs, result);
+        REQUIRE(result.errorCount_ == 2);
+        records = AuditLog::ReadFile(path);
+        REQUIRE(records.size() == 5);
+        REQUIRE(records[4].error_ == Error::ExpectedShortAlias);
+        REQUIRE(records[4].errorArgIndex_ == 3);
+    }
+
+    SECTION("Args parser errors have no index")
+    {
+        ArgParser customParser([&](Error error, const std::string&){ errors.push_back(error); }, GetDefaultPosixArgsParser());
+        customParser.SetAuditLog(auditLog);
+        customParser.ParseArgs(badToken.Argc(), badToken.Argv());
+        records = AuditLog::ReadFile(path);
+        REQUIRE(records.size() == 4);
+        REQUIRE(records[3].error_ == Error::ExpectedShortAlias);
+        REQUIRE(records[3].errorArgIndex_ == -1);
+    }
+
+    SECTION("Concurrent writers never interleave")
+    {
+        std::vector<std::thread> writers;
+        for (int writer = 0; writer < 4; writer++) {
+            writers.emplace_back([&, writer]()
+            {
+                AuditLog log(path);
+                ArgvBuffer args{ "./app/path/test.exe", "--id", std::to_string(writer), std::string(static_cast<std::size_t>(writer) * 1000, 'x') };
+                for (int i = 0; i < 50; i++) {
+                    log.Append(args.Argc(), args.Argv(), Error::None, -1);
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        records = AuditLog::ReadFile(path);
+        REQUIRE(records.size() == 203);
+        for (std::size_t i = 3; i < records.size(); i++) {
+            REQUIRE(records[i].args_.size() == 4);
+            REQUIRE(records[i].args_[3].size() == std::stoul(records[i].args_[2]) * 1000);
+        }
+    }
+
+    SECTION("Truncated record")
+    {
+        fs::resize_file(path, fs::file_size(path) - 1);
+        REQUIRE(AuditLog::ReadFile(path).size() == 2);
+    }
+
+    auditLog.reset();
+    parser.SetAuditLog(nullptr);
+    fs::remove(path);
+}
+
 } // namespace EzArgs
 
 int main(int argc, char* argv[])
@@ -0,0 +1,59 @@
+#include "EzArgs.h"
+
+#include <ctime>
+#include <iomanip>
+
+/**
+ * Prints every record of one or more EzArgs audit logs, a line per record:
+ *   2026-10-18T09:30:00.123456Z pid=1234 ok ./tool --threads 8
+ *   2026-10-18T09:30:01.000042Z pid=1235 error=15@argv[2] ./tool --threads x
+ */
+int main(int argc, char** argv)
+{
+    using namespace EzArgs;
+
+    bool json = false;
+    ArgParser parser;
+    parser.SetOptions({
+                          {"h,help", PrintHelp(parser, true, std::cout, "Usage: AuditLogReader [--json] -- <log>..."), "Prints this help"},
+                          {"j,json", DetectPresence(json), "Prints a JSON object per record"},
+                      });
+    std::vector<std::string> paths = parser.ParseArgs(argc, argv);
+
+    for (const auto& path : paths) {
+        for (const AuditRecord& record : AuditLog::ReadFile(path)) {
+            std::time_t seconds = static_cast<std::time_t>(record.timestamp_ / 1000000);
+            std::tm utc = *std::gmtime(&seconds);
+            std::cout << (json ? "{\"time\":\"" : "") << std::put_time(&utc, "%Y-%m-%dT%H:%M:%S") << '.' << std::setw(6) << std::setfill('0') << record.timestamp_ % 1000000 << 'Z';
+            if (json) {
+                std::cout << "\",\"pid\":" << record.processId_ << ",\"error\":" << static_cast<int>(record.error_) << ",\"errorArgIndex\":" << record.errorArgIndex_ << ",\"args\":[";
+                for (std::size_t i = 0; i < record.args_.size(); i++) {
+                    std::cout << (i == 0 ? "\"" : ",\"");
+                    for (char c : record.args_[i]) {
+                        if (c == '"' || c == '\\') {
+                            std::cout << '\\' << c;
+                        } else if (static_cast<unsigned char>(c) < 0x20) {
+                            std::cout << "\\u" << std::hex << std::setw(4) << static_cast<int>(c) << std::dec;
+                        } else {
+                            std::cout << c;
+                        }
+                    }
+                    std::cout << '"';
+                }
+                std::cout << "]}" << std::endl;
+            } else {
+                std::cout << " pid=" << record.processId_;
+                if (record.error_ == Error::None) {
+                    std::cout << " ok";
+                } else {
+                    std::cout << " error=" << static_cast<int>(record.error_) << "@argv[" << record.errorArgIndex_ << ']';
+                }
+                for (const auto& arg : record.args_) {
+                    std::cout << ' ' << arg;
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+    return 0;
+}